@@ -19,4 +19,10 @@ echo
 echo
 "$DIR"/test_cookies.sh "$BASE_URL" "$REQ_PATH"
 
+echo
+"$DIR"/test_fcgi_multiplex.sh # starts its own servers from bin/
+
+echo
+"$DIR"/test_multipart_stream.sh # starts its own server from bin/
+
 echo '== ALL TESTS COMPLETED ==' >&2
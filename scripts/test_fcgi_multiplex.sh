@@ -0,0 +1,163 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# FastCGI connection reuse test. Starts its own servers on temporary UNIX sockets
+# and, on one keep-alive connection each:
+#  - checks the FCGI_GET_VALUES answer,
+#  - interleaves BEGIN/PARAMS/STDIN of several request IDs and checks every END_REQUEST,
+#  - checks that --no-fcgi-multiplex answers a second concurrent ID with FCGI_CANT_MPX_CONN.
+# Usage: ./test_fcgi_multiplex.sh [SERVER_BIN]
+DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+SERVER_BIN=${1:-${SERVER_BIN:-$DIR/../bin/wasapi-server}}
+TMP=$(mktemp -d)
+PIDS=()
+cleanup() {
+	for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null || true; done
+	wait 2>/dev/null || true
+	rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+start_server() { # socket, extra args...
+	local sock="$1"
+	shift
+	"$SERVER_BIN" --fcgi-socket "$sock" --ws-port 0 --max-in-flight 8 --log-level 0 "$@" &
+	PIDS+=("$!")
+	for _ in $(seq 100); do
+		[[ -S "$sock" ]] && return 0
+		sleep 0.05
+	done
+	echo "Server on $sock did not start" >&2
+	exit 1
+}
+
+start_server "$TMP/mpx.sock"
+start_server "$TMP/single.sock" --no-fcgi-multiplex
+
+echo "== FastCGI multiplexing against $SERVER_BIN" >&2
+python3 - "$TMP/mpx.sock" "$TMP/single.sock" <<'PY'
+import socket, struct, sys
+
+BEGIN, ABORT, END, PARAMS, STDIN, STDOUT, STDERR, GET_VALUES, GET_VALUES_RESULT = 1, 2, 3, 4, 5, 6, 7, 9, 10
+REQUEST_COMPLETE, CANT_MPX_CONN = 0, 1
+
+def record(t, rid, content=b""):
+	return struct.pack(">BBHHBB", 1, t, rid, len(content), 0, 0) + content
+
+def enc_len(n):
+	return bytes([n]) if n < 128 else struct.pack(">I", n | 0x80000000)
+
+def pairs(d):
+	return b"".join(enc_len(len(k)) + enc_len(len(v)) + k + v for k, v in ((k.encode(), v.encode()) for k, v in d.items()))
+
+def decode_pairs(b):
+	out, i = {}, 0
+	def length():
+		nonlocal i
+		if b[i] < 128:
+			i += 1
+			return b[i - 1]
+		i += 4
+		return struct.unpack(">I", b[i - 4:i])[0] & 0x7FFFFFFF
+	while i < len(b):
+		kl = length(); vl = length()
+		out[b[i:i + kl].decode()] = b[i + kl:i + kl + vl].decode()
+		i += kl + vl
+	return out
+
+class Conn:
+	def __init__(self, path):
+		self.s = socket.socket(socket.AF_UNIX)
+		self.s.settimeout(10)
+		self.s.connect(path)
+		self.buf = b""
+
+	def send(self, data):
+		self.s.sendall(data)
+
+	def next_record(self):
+		while True:
+			if len(self.buf) >= 8:
+				_, t, rid, cl, pl, _ = struct.unpack(">BBHHBB", self.buf[:8])
+				if len(self.buf) >= 8 + cl + pl:
+					content = self.buf[8:8 + cl]
+					self.buf = self.buf[8 + cl + pl:]
+					return t, rid, content
+			d = self.s.recv(65536)
+			if not d:
+				raise RuntimeError("connection closed")
+			self.buf += d
+
+	def until_ended(self, ids):
+		out = {i: b"" for i in ids}
+		ended = {}
+		while len(ended) < len(ids):
+			t, rid, content = self.next_record()
+			if t == STDOUT and rid in out:
+				out[rid] += content
+			elif t == END and rid in out:
+				app, proto = struct.unpack(">IB3x", content)
+				ended[rid] = proto
+		return out, ended
+
+failures = 0
+def check(name, cond, info=""):
+	global failures
+	print(("ok   " if cond else "FAIL ") + name + ("" if cond else " :: " + str(info)))
+	if not cond:
+		failures += 1
+
+def env(i):
+	return {"REQUEST_METHOD": "POST", "REQUEST_URI": "/mpx/%d" % i, "QUERY_STRING": "id=%d" % i,
+	        "CONTENT_TYPE": "application/x-www-form-urlencoded", "CONTENT_LENGTH": "11"}
+
+begin_keep = struct.pack(">HB5x", 1, 1)
+
+# 1. FCGI_GET_VALUES on the multiplexing server
+c = Conn(sys.argv[1])
+c.send(record(GET_VALUES, 0, pairs({"FCGI_MAX_CONNS": "", "FCGI_MAX_REQS": "", "FCGI_MPXS_CONNS": ""})))
+t, rid, content = c.next_record()
+values = decode_pairs(content) if t == GET_VALUES_RESULT else {}
+check("GET_VALUES answered", t == GET_VALUES_RESULT and rid == 0, (t, rid))
+check("FCGI_MPXS_CONNS=1", values.get("FCGI_MPXS_CONNS") == "1", values)
+check("FCGI_MAX_REQS=8", values.get("FCGI_MAX_REQS") == "8", values)
+check("no FCGI_MAX_CONNS", "FCGI_MAX_CONNS" not in values, values)
+
+# 2. several request IDs interleaved record by record on the same connection
+ids = [1, 2, 3, 4]
+for i in ids:
+	c.send(record(BEGIN, i, begin_keep))
+for i in ids:
+	c.send(record(PARAMS, i, pairs(env(i))))
+for i in ids:
+	c.send(record(PARAMS, i))
+for i in ids:
+	c.send(record(STDIN, i, b"body=%05d" % i))
+for i in reversed(ids):
+	c.send(record(STDIN, i))
+out, ended = c.until_ended(ids)
+for i in ids:
+	check("request %d completed" % i, ended.get(i) == REQUEST_COMPLETE, ended.get(i))
+	check("request %d got its own output" % i, b"/mpx/%d" % i in out[i] and b"/mpx/%d" % (i % len(ids) + 1) not in out[i], out[i][:200])
+
+# the connection stays usable afterwards
+c.send(record(BEGIN, 7, begin_keep) + record(PARAMS, 7, pairs(env(7))) + record(PARAMS, 7) + record(STDIN, 7, b"body=00007") + record(STDIN, 7))
+out, ended = c.until_ended([7])
+check("keep-alive connection reused", ended.get(7) == REQUEST_COMPLETE, ended)
+
+# 3. --no-fcgi-multiplex: a second ID while the first is running is refused
+c = Conn(sys.argv[2])
+c.send(record(GET_VALUES, 0, pairs({"FCGI_MPXS_CONNS": ""})))
+t, rid, content = c.next_record()
+check("FCGI_MPXS_CONNS=0 without multiplexing", t == GET_VALUES_RESULT and decode_pairs(content).get("FCGI_MPXS_CONNS") == "0", content)
+c.send(record(BEGIN, 1, begin_keep) + record(PARAMS, 1, pairs(env(1))))
+c.send(record(BEGIN, 2, begin_keep))
+out, ended = c.until_ended([2])
+check("second concurrent ID gets FCGI_CANT_MPX_CONN", ended.get(2) == CANT_MPX_CONN, ended)
+c.send(record(PARAMS, 1) + record(STDIN, 1, b"body=00001") + record(STDIN, 1))
+out, ended = c.until_ended([1])
+check("first request still completes", ended.get(1) == REQUEST_COMPLETE and b"/mpx/1" in out[1], ended)
+
+sys.exit(1 if failures else 0)
+PY
+echo "== FastCGI multiplex test complete ==" >&2
@@ -0,0 +1,218 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Streaming multipart parser test. Starts its own server on a temporary UNIX socket
+# and sends multipart/form-data bodies in FCGI_STDIN records of random sizes:
+#  - checks field values and the size, hash_xxh3 and contents of each upload,
+#  - splits the body inside every byte of a delimiter so it is carried across records,
+#  - sends a part without headers between two fields,
+#  - ends the body inside an upload and checks that it is reported as partial.
+# hash_xxh3 is only compared when the Python xxhash module is installed.
+# Usage: ./test_multipart_stream.sh [SERVER_BIN]
+DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+SERVER_BIN=${1:-${SERVER_BIN:-$DIR/../bin/wasapi-server}}
+TMP=$(mktemp -d)
+PIDS=()
+cleanup() {
+	for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null || true; done
+	wait 2>/dev/null || true
+	rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+mkdir "$TMP/uploads"
+"$SERVER_BIN" --fcgi-socket "$TMP/mp.sock" --ws-port 0 --log-level 0 \
+	--upload-tmp "$TMP/uploads" --upload-hash xxh3 --keep-uploads &
+PIDS+=("$!")
+for _ in $(seq 100); do
+	[[ -S "$TMP/mp.sock" ]] && break
+	sleep 0.05
+done
+[[ -S "$TMP/mp.sock" ]] || { echo "Server on $TMP/mp.sock did not start" >&2; exit 1; }
+
+echo "== Streaming multipart against $SERVER_BIN" >&2
+python3 - "$TMP/mp.sock" <<'PY'
+import random, re, socket, struct, sys
+
+try:
+	import xxhash
+except ImportError:
+	xxhash = None
+
+BEGIN, END, PARAMS, STDIN, STDOUT = 1, 3, 4, 5, 6
+REQUEST_COMPLETE = 0
+BOUNDARY = b"----wasapiStreamBoundary7Xq"
+
+def record(t, rid, content=b""):
+	return struct.pack(">BBHHBB", 1, t, rid, len(content), 0, 0) + content
+
+def enc_len(n):
+	return bytes([n]) if n < 128 else struct.pack(">I", n | 0x80000000)
+
+def pairs(d):
+	return b"".join(enc_len(len(k)) + enc_len(len(v)) + k + v for k, v in ((k.encode(), v.encode()) for k, v in d.items()))
+
+class Conn:
+	def __init__(self, path):
+		self.s = socket.socket(socket.AF_UNIX)
+		self.s.settimeout(10)
+		self.s.connect(path)
+		self.buf = b""
+
+	def send(self, data):
+		self.s.sendall(data)
+
+	def next_record(self):
+		while True:
+			if len(self.buf) >= 8:
+				_, t, rid, cl, pl, _ = struct.unpack(">BBHHBB", self.buf[:8])
+				if len(self.buf) >= 8 + cl + pl:
+					content = self.buf[8:8 + cl]
+					self.buf = self.buf[8 + cl + pl:]
+					return t, rid, content
+			d = self.s.recv(65536)
+			if not d:
+				raise RuntimeError("connection closed")
+			self.buf += d
+
+	def until_ended(self, ids):
+		out = {i: b"" for i in ids}
+		ended = {}
+		while len(ended) < len(ids):
+			t, rid, content = self.next_record()
+			if t == STDOUT and rid in out:
+				out[rid] += content
+			elif t == END and rid in out:
+				app, proto = struct.unpack(">IB3x", content)
+				ended[rid] = proto
+		return out, ended
+
+failures = 0
+def check(name, cond, info=""):
+	global failures
+	print(("ok   " if cond else "FAIL ") + name + ("" if cond else " :: " + str(info)))
+	if not cond:
+		failures += 1
+
+def part(headers, data):
+	return b"--" + BOUNDARY + b"\r\n" + b"".join(h + b"\r\n" for h in headers) + b"\r\n" + data + b"\r\n"
+
+def field(name, value):
+	return part([b'Content-Disposition: form-data; name="%s"' % name], value)
+
+def upload(name, filename, data):
+	return part([b'Content-Disposition: form-data; name="%s"; filename="%s"' % (name, filename),
+	             b"Content-Type: application/octet-stream"], data)
+
+CLOSE = b"--" + BOUNDARY + b"--\r\n"
+
+def section(out, title):
+	m = re.search(rb"-- " + title + rb" --\n(.*?)\n-- ", out, re.S)
+	return m.group(1) if m else b""
+
+def parse_params(out):
+	return {m.group(1): m.group(2) for m in re.finditer(rb'^  (\w*): "(.*)"$', section(out, b"PARAMS"), re.M)}
+
+def parse_files(out):
+	files = []
+	for block in re.findall(rb"\{\n(.*?)\n  \}", section(out, b"FILES"), re.S):
+		entry = {}
+		for m in re.finditer(rb'^\s*(\w+): (.*)$', block, re.M):
+			v = m.group(2)
+			entry[m.group(1).decode()] = v[1:-1].decode() if v.startswith(b'"') else v.decode()
+		files.append(entry)
+	return files
+
+def check_upload(name, entry, data, partial=False):
+	check(name + ": size", entry.get("size") == str(len(data)), entry)
+	check(name + ": partial" if partial else name + ": not partial", (entry.get("partial") == "true") == partial, entry)
+	if xxhash:
+		check(name + ": hash_xxh3", entry.get("hash_xxh3") == xxhash.xxh3_64_hexdigest(data), entry)
+	try:
+		with open(entry.get("temp_path", ""), "rb") as f:
+			stored = f.read()
+	except OSError as e:
+		stored = e
+	check(name + ": temp file contents", stored == data, entry)
+
+begin_keep = struct.pack(">HB5x", 1, 1)
+next_id = 0
+
+def post(c, body, chunks, content_length=None):
+	"""Sends body as STDIN records cut at chunks (a list of sizes) and returns the output."""
+	global next_id
+	next_id = next_id % 60000 + 1
+	rid = next_id
+	env = {"REQUEST_METHOD": "POST", "REQUEST_URI": "/multipart/%d" % rid,
+	       "CONTENT_TYPE": "multipart/form-data; boundary=" + BOUNDARY.decode(),
+	       "CONTENT_LENGTH": str(len(body) if content_length is None else content_length)}
+	c.send(record(BEGIN, rid, begin_keep) + record(PARAMS, rid, pairs(env)) + record(PARAMS, rid))
+	pos = 0
+	for n in chunks:
+		c.send(record(STDIN, rid, body[pos:pos + n]))
+		pos += n
+	c.send(record(STDIN, rid))
+	out, ended = c.until_ended([rid])
+	check("request %d completed" % rid, ended.get(rid) == REQUEST_COMPLETE, ended)
+	return out[rid]
+
+def random_chunks(n, rng, largest=9000):
+	sizes = []
+	while n > 0:
+		sizes.append(min(n, rng.randint(1, largest)))
+		n -= sizes[-1]
+	return sizes
+
+rng = random.Random(12)
+c = Conn(sys.argv[1])
+
+# 1. fields and uploads in random record sizes; edge.bin ends in delimiter prefixes
+blob = bytes(rng.getrandbits(8) for _ in range(300000))
+tricky = b"\r\n--" + BOUNDARY[:-1] + b"\r\n-" + b"--" * 50 + b"\r\n--" + BOUNDARY[:5]
+body = (field(b"title", b"stream test") + upload(b"data", b"blob.bin", blob) + field(b"note", b"a=b&c")
+        + upload(b"edge", b"edge.bin", tricky) + CLOSE)
+for round_no in range(3):
+	out = post(c, body, random_chunks(len(body), rng))
+	params = parse_params(out)
+	files = parse_files(out)
+	check("random records %d: fields" % round_no, params.get(b"title") == b"stream test" and params.get(b"note") == b"a=b&c", params)
+	check("random records %d: two uploads" % round_no, [f.get("filename") for f in files] == ["blob.bin", "edge.bin"], files)
+	if len(files) == 2:
+		check_upload("random records %d: blob.bin" % round_no, files[0], blob)
+		check_upload("random records %d: edge.bin" % round_no, files[1], tricky)
+
+# 2. a record boundary inside every byte of the delimiter after an upload
+data = b"0123456789" * 20
+body = upload(b"f", b"split.bin", data) + field(b"after", b"yes") + CLOSE
+delim_at = body.index(b"\r\n--" + BOUNDARY, len(data))
+bad = []
+for k in range(len(BOUNDARY) + 5):
+	out = post(c, body, [delim_at + k, len(body) - delim_at - k])
+	files = parse_files(out)
+	if not (len(files) == 1 and files[0].get("size") == str(len(data)) and parse_params(out).get(b"after") == b"yes"):
+		bad.append(k)
+check("delimiter split across records", not bad, bad)
+
+# 3. a part without headers between two fields
+body = field(b"first", b"1") + b"--" + BOUNDARY + b"\r\n\r\nno headers\r\n" + field(b"last", b"2") + CLOSE
+out = post(c, body, random_chunks(len(body), rng, 7))
+params = parse_params(out)
+check("part without headers: neighbouring fields", params.get(b"first") == b"1" and params.get(b"last") == b"2", params)
+check("part without headers: no upload", parse_files(out) == [], parse_files(out))
+
+# 4. the body ends inside an upload
+data = bytes(rng.getrandbits(8) for _ in range(50000))
+body = field(b"kept", b"ok") + upload(b"f", b"cut.bin", data) + CLOSE
+cut = body.index(data) + 30000
+out = post(c, body[:cut], random_chunks(cut, rng), content_length=len(body))
+files = parse_files(out)
+check("truncated body: field kept", parse_params(out).get(b"kept") == b"ok", parse_params(out))
+check("truncated body: one upload", len(files) == 1, files)
+if files:
+	check_upload("truncated body: cut.bin", files[0], data[:30000], partial=True)
+
+if not xxhash:
+	print("note: Python xxhash module missing, hash_xxh3 not compared")
+sys.exit(1 if failures else 0)
+PY
+echo "== Streaming multipart test complete ==" >&2
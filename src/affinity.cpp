@@ -0,0 +1,115 @@
+#include "affinity.h"
+#include "logger.h"
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+bool parse_cpu_list(const std::string& text, std::vector<int>& cpus)
+{
+	std::stringstream ss(text);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		if (item.empty())
+			continue;
+		char* end = nullptr;
+		long lo = std::strtol(item.c_str(), &end, 10);
+		long hi = lo;
+		if (*end == '-')
+			hi = std::strtol(end + 1, &end, 10);
+		if (end == item.c_str() || *end != '\0' || lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+			return false;
+		for (long c = lo; c <= hi; ++c)
+			cpus.push_back((int)c);
+	}
+	return true;
+}
+
+void pin_thread(const std::vector<int>& cpus, size_t index)
+{
+	if (cpus.empty())
+		return;
+	int cpu = cpus[index % cpus.size()];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (rc != 0)
+		log_error("Pinning to CPU %d failed: %s", cpu, std::strerror(rc));
+	else
+		log_debug("Pinned to CPU %d", cpu);
+}
+
+// CPU -> node from sysfs, read once.
+struct NumaTopology
+{
+	int nodes = 1;
+	std::vector<int> cpu_node;
+
+	NumaTopology()
+	{
+		std::ifstream online("/sys/devices/system/node/online");
+		std::string line;
+		std::vector<int> ids;
+		if (!online || !std::getline(online, line) || !parse_cpu_list(line, ids) || ids.empty())
+			return;
+		for (int n : ids)
+		{
+			if (n + 1 > nodes)
+				nodes = n + 1;
+			std::ifstream list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+			std::vector<int> cpus;
+			if (!list || !std::getline(list, line) || !parse_cpu_list(line, cpus))
+				continue;
+			for (int c : cpus)
+			{
+				if ((size_t)c >= cpu_node.size())
+					cpu_node.resize(c + 1, 0);
+				cpu_node[c] = n;
+			}
+		}
+	}
+};
+
+static const NumaTopology& topology()
+{
+	static NumaTopology t;
+	return t;
+}
+
+int numa_node_count()
+{
+	return topology().nodes;
+}
+
+int current_numa_node()
+{
+	const NumaTopology& t = topology();
+	if (t.nodes == 1)
+		return 0;
+	int cpu = sched_getcpu(); // vDSO, no syscall
+	return cpu >= 0 && (size_t)cpu < t.cpu_node.size() ? t.cpu_node[cpu] : 0;
+}
+
+bool bind_memory_to_node(void* addr, size_t len, int node)
+{
+	if (node < 0 || len == 0)
+		return false;
+	unsigned long mask[16] = {}; // up to 1024 nodes
+	if ((size_t)node >= sizeof(mask) * 8)
+		return false;
+	mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0)
+	{
+		log_error("mbind to node %d failed: %s", node, std::strerror(errno));
+		return false;
+	}
+	return true;
+}
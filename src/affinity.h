@@ -0,0 +1,24 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// CPU pinning and NUMA placement, straight on the syscalls (no libnuma). All of
+// it is best effort: on failure the thread or memory keeps the kernel's default.
+
+// "0-3,8,10-11" -> {0,1,2,3,8,10,11}; false if the list is malformed.
+bool parse_cpu_list(const std::string& text, std::vector<int>& cpus);
+
+// Pin the calling thread to cpus[index % cpus.size()]; nothing for an empty list.
+void pin_thread(const std::vector<int>& cpus, size_t index);
+
+int numa_node_count(); // 1 on machines without NUMA
+int current_numa_node(); // node of the CPU the caller runs on, 0 if unknown
+
+// Prefer node for the pages of [addr, addr + len) that are not touched yet.
+// addr must be page-aligned.
+bool bind_memory_to_node(void* addr, size_t len, int node);
+
+#endif // AFFINITY_H
@@ -1,5 +1,7 @@
 #include "config.h"
 #include "fileio.h"
+#include "content_hash.h"
+#include "affinity.h"
 #include <algorithm>
 #include <cstdlib>
 #include <iostream>
@@ -24,6 +26,12 @@ bool config_parse_args(int argc, char* argv[], std::vector<std::string>& errors)
 			 { global_config.fcgi_port = (uint16_t)std::stoi(v); } },
 		Opt{ "--fcgi-socket", true, [](const char* v)
 			 { global_config.fcgi_socket_path = v; } },
+		Opt{ "--fcgi-reactors", true, [](const char* v)
+			 { global_config.fcgi_reactors = (uint32_t)std::stoul(v); } },
+		Opt{ "--io-backend", true, [](const char* v)
+			 { global_config.io_backend = v; } },
+		Opt{ "--no-fcgi-multiplex", false, [](const char*)
+			 { global_config.fcgi_multiplex = false; } },
 		Opt{ "--ws-port", true, [](const char* v)
 			 { global_config.ws_port = (uint16_t)std::stoi(v); } },
 		Opt{ "--ws-socket", true, [](const char* v)
@@ -32,16 +40,78 @@ bool config_parse_args(int argc, char* argv[], std::vector<std::string>& errors)
 			 { global_config.backlog = std::stoi(v); } },
 		Opt{ "--max-in-flight", true, [](const char* v)
 			 { global_config.max_in_flight = (uint32_t)std::stoul(v); } },
+		Opt{ "--worker-threads", true, [](const char* v)
+			 { global_config.worker_threads = (uint32_t)std::stoul(v); } },
+		Opt{ "--blocking-threads", true, [](const char* v)
+			 { global_config.blocking_threads = (uint32_t)std::stoul(v); } },
+		Opt{ "--weight-fcgi", true, [](const char* v)
+			 { global_config.weight_fcgi = (uint32_t)std::stoul(v); } },
+		Opt{ "--weight-http", true, [](const char* v)
+			 { global_config.weight_http = (uint32_t)std::stoul(v); } },
+		Opt{ "--weight-ws", true, [](const char* v)
+			 { global_config.weight_ws = (uint32_t)std::stoul(v); } },
+		Opt{ "--tenant-var", true, [](const char* v)
+			 { global_config.tenant_var = v; } },
+		Opt{ "--reactor-cpus", true, [&errors](const char* v)
+			 {
+				 global_config.reactor_cpus.clear();
+				 if (!parse_cpu_list(v, global_config.reactor_cpus))
+					 errors.push_back(std::string("Bad CPU list: ") + v); } },
+		Opt{ "--worker-cpus", true, [&errors](const char* v)
+			 {
+				 global_config.worker_cpus.clear();
+				 if (!parse_cpu_list(v, global_config.worker_cpus))
+					 errors.push_back(std::string("Bad CPU list: ") + v); } },
+		Opt{ "--no-numa", false, [](const char*)
+			 { global_config.numa_arenas = false; } },
+		Opt{ "--file-threads", true, [](const char* v)
+			 { global_config.file_threads = (uint32_t)std::stoul(v); } },
 		Opt{ "--max-params", true, [](const char* v)
 			 { global_config.max_params_bytes = (size_t)std::stoull(v); } },
 		Opt{ "--max-stdin", true, [](const char* v)
 			 { global_config.max_stdin_bytes = (size_t)std::stoull(v); } },
+		Opt{ "--max-parsed-body", true, [](const char* v)
+			 { global_config.max_parsed_body_bytes = (size_t)std::stoull(v); } },
+		Opt{ "--body-memory", true, [](const char* v)
+			 { global_config.body_memory_limit = (size_t)std::stoull(v); } },
+		Opt{ "--max-conn-input", true, [](const char* v)
+			 { global_config.max_conn_input_bytes = (size_t)std::stoull(v); } },
+		Opt{ "--max-input", true, [](const char* v)
+			 { global_config.max_input_bytes = (size_t)std::stoull(v); } },
+		Opt{ "--max-request-time", true, [](const char* v)
+			 { global_config.max_request_time = std::stod(v); } },
+		Opt{ "--idle-timeout", true, [](const char* v)
+			 { global_config.idle_timeout = std::stod(v); } },
+		Opt{ "--ws-ping-interval", true, [](const char* v)
+			 { global_config.ws_ping_interval = std::stod(v); } },
+		Opt{ "--ws-ping-timeout", true, [](const char* v)
+			 { global_config.ws_ping_timeout = std::stod(v); } },
 		Opt{ "--arena-capacity", true, [](const char* v)
 			 { global_config.arena_capacity = (size_t)std::stoull(v); } },
+		Opt{ "--arena-medium", true, [](const char* v)
+			 { global_config.arena_medium_capacity = (size_t)std::stoull(v); } },
+		Opt{ "--arena-small", true, [](const char* v)
+			 { global_config.arena_small_capacity = (size_t)std::stoull(v); } },
+		Opt{ "--arena-block", true, [](const char* v)
+			 { global_config.arena_block_size = (size_t)std::stoull(v); } },
+		Opt{ "--arena-watermark", true, [](const char* v)
+			 { global_config.arena_watermark = (size_t)std::stoull(v); } },
+		Opt{ "--arena-hugepages", false, [](const char*)
+			 { global_config.arena_hugepages = true; } },
 		Opt{ "--output-buffer", true, [](const char* v)
 			 { global_config.output_buffer_initial = (size_t)std::stoull(v); } },
+		Opt{ "--response-high-water", true, [](const char* v)
+			 { global_config.response_high_water = (size_t)std::stoull(v); } },
+		Opt{ "--input-buffer", true, [](const char* v)
+			 { global_config.input_buffer_size = (size_t)std::stoull(v); } },
 		Opt{ "--upload-tmp", true, [](const char* v)
 			 { global_config.upload_tmp_dir = v; } },
+		Opt{ "--upload-hash", true, [&errors](const char* v)
+			 {
+				 ContentHash::Kind kind;
+				 if (!ContentHash::kind_from_name(v, kind))
+					 errors.push_back(std::string("Unknown upload hash: ") + v);
+				 global_config.upload_hash = v; } },
 		Opt{ "--body-preview", true, [](const char* v)
 			 { global_config.body_preview_limit = (size_t)std::stoull(v); } },
 		Opt{ "--print-env-limit", true, [](const char* v)
@@ -152,7 +222,7 @@ bool load_kv_file(const std::string& path, DynamicVariable& out)
 		{
 			if (existing->type == DynamicVariable::STRING)
 			{
-				std::string prev = existing->data.s;
+				std::string prev(existing->data.s);
 				*existing = DynamicVariable::make_array();
 				existing->push(DynamicVariable::make_string(prev));
 				existing->push(DynamicVariable::make_string(value));
@@ -13,6 +13,9 @@ struct GlobalConfig
 	uint16_t fcgi_port = 9000;
 	std::string fcgi_socket_path = "";
 	std::string fcgi_path_prefix = "";
+	uint32_t fcgi_reactors = 1; // FastCGI IO loops (0 = one per core)
+	std::string io_backend = "epoll"; // reactor backend for FastCGI and WebSocket: "epoll" or "uring"
+	bool fcgi_multiplex = true; // run several request IDs concurrently on one FastCGI connection
 
 	uint16_t ws_port = 9001;
 	std::string ws_socket_path = "";
@@ -20,16 +23,42 @@ struct GlobalConfig
 
 	int backlog = 256 * 16;
 
-	size_t arena_capacity = 256 * 1024;
-	size_t output_buffer_initial = 32 * 1024;
+	size_t arena_capacity = 256 * 1024; // large arenas; a quarter of max_in_flight
+	size_t arena_medium_capacity = 64 * 1024; // another quarter
+	size_t arena_small_capacity = 16 * 1024; // the other half, where FastCGI requests start
+	size_t arena_block_size = 64 * 1024; // chained onto an arena that runs full
+	size_t arena_blocks_cached = 64; // free blocks kept mapped for reuse
+	size_t arena_watermark = 64 * 1024; // committed bytes a free arena keeps, the rest is decommitted
+	bool arena_hugepages = false; // transparent huge pages for the arena reservation
+	size_t output_buffer_initial = 32 * 1024; // ResponseWriter buffer, flushed as FCGI_STDOUT when full
+	size_t response_high_water = 1024 * 1024; // unsent response bytes per connection before flush() blocks (0 = unlimited)
+	size_t input_buffer_size = 128 * 1024; // per-connection FastCGI receive ring (>= one max record)
 
 	std::string upload_tmp_dir = "/tmp";
-
-	uint32_t max_in_flight = 8;
+	std::string upload_hash = "xxh3"; // digest of uploaded files: "xxh3", "sha256", "fnv1a64" or "none"
+
+	uint32_t max_in_flight = 8; // requests held at once, one arena each; independent of the thread counts
+	uint32_t worker_threads = 0; // CPU pool running the handlers (0 = one per core)
+	uint32_t blocking_threads = 4; // pool for request stages that wait on the disk (0 = use the CPU pool)
+	uint32_t weight_fcgi = 4; // tasks per scheduling turn for FastCGI requests,
+	uint32_t weight_http = 2; // plain HTTP on the WebSocket port
+	uint32_t weight_ws = 1; // and WebSocket messages
+	std::string tenant_var = "DOCUMENT_ROOT"; // env variable requests of a class are fair-queued by ("" = off)
+	std::vector<int> reactor_cpus; // pin FastCGI reactor i (then the ws thread) to reactor_cpus[i % n]; empty = float
+	std::vector<int> worker_cpus; // same for the CPU pool's workers
+	bool numa_arenas = true; // spread arenas over the NUMA nodes, taken by the IO thread from its own node
+	uint32_t file_threads = 2; // background threads for upload writes and temp-file removal
 	size_t max_params_bytes = 256 * 1024;
-	size_t max_stdin_bytes = 2 * 1024 * 1024;
+	size_t max_stdin_bytes = 256 * 1024 * 1024; // request body limit; past body_memory_limit it lives on disk
+	size_t max_parsed_body_bytes = 2 * 1024 * 1024; // limit for bodies parsed whole in memory (JSON, urlencoded)
+	size_t body_memory_limit = 64 * 1024; // request body bytes kept in memory before spilling to upload_tmp_dir
+	size_t max_conn_input_bytes = 8 * 1024 * 1024; // request input held per FastCGI connection before reading pauses (0 = unlimited)
+	size_t max_input_bytes = 256 * 1024 * 1024; // same, across all connections (0 = unlimited)
 	size_t max_memory_per_request = 16 * 1024 * 1024;
 	double max_request_time = 30.0;
+	double idle_timeout = 60.0; // seconds a FastCGI connection may sit without requests (0 = never)
+	double ws_ping_interval = 30.0; // seconds of websocket silence before a ping (0 = no pings)
+	double ws_ping_timeout = 10.0; // seconds to wait for the pong before closing
 
 	size_t body_preview_limit = 1024;
 	size_t print_env_limit = 0;
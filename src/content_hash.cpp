@@ -0,0 +1,360 @@
+#include "content_hash.h"
+#include "logger.h"
+#include <openssl/evp.h>
+#include <cstdio>
+#include <cstring>
+
+static const uint64_t FNV_OFFSET = 1469598103934665603ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static const uint64_t PRIME32_1 = 0x9E3779B1U;
+static const uint64_t PRIME32_2 = 0x85EBCA77U;
+static const uint64_t PRIME32_3 = 0xC2B2AE3DU;
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+static const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+static const size_t STRIPE = 64;
+static const size_t STRIPES_PER_BLOCK = 16; // (secret size - STRIPE) / 8
+static const size_t SHORT_MAX = 240;
+
+static const uint8_t SECRET[192] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint32_t read32(const uint8_t* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v)); // XXH3 reads little-endian words; so does every host we build for
+	return v;
+}
+
+static inline uint64_t read64(const uint8_t* p)
+{
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t rotl64(uint64_t v, int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b)
+{
+	unsigned __int128 p = (unsigned __int128)a * b;
+	return (uint64_t)p ^ (uint64_t)(p >> 64);
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	return h ^ (h >> 32);
+}
+
+static inline uint64_t xxh3_avalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= PRIME_MX1;
+	return h ^ (h >> 32);
+}
+
+static inline uint64_t mix16(const uint8_t* p, const uint8_t* s)
+{
+	return mul128_fold64(read64(p) ^ read64(s), read64(p + 8) ^ read64(s + 8));
+}
+
+static uint64_t xxh3_short(const uint8_t* p, size_t len)
+{
+	const uint8_t* s = SECRET;
+	if (len == 0)
+		return xxh64_avalanche(read64(s + 56) ^ read64(s + 64));
+	if (len <= 3)
+	{
+		uint32_t combined = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24) | p[len - 1] | ((uint32_t)len << 8);
+		return xxh64_avalanche(combined ^ (uint64_t)(read32(s) ^ read32(s + 4)));
+	}
+	if (len <= 8)
+	{
+		uint64_t v = read32(p + len - 4) + ((uint64_t)read32(p) << 32);
+		uint64_t h = v ^ (read64(s + 8) ^ read64(s + 16));
+		h ^= rotl64(h, 49) ^ rotl64(h, 24);
+		h *= PRIME_MX2;
+		h ^= (h >> 35) + len;
+		h *= PRIME_MX2;
+		return h ^ (h >> 28);
+	}
+	if (len <= 16)
+	{
+		uint64_t lo = read64(p) ^ (read64(s + 24) ^ read64(s + 32));
+		uint64_t hi = read64(p + len - 8) ^ (read64(s + 40) ^ read64(s + 48));
+		return xxh3_avalanche(len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi));
+	}
+	uint64_t acc = len * PRIME64_1;
+	if (len <= 128)
+	{
+		if (len > 32)
+		{
+			if (len > 64)
+			{
+				if (len > 96)
+				{
+					acc += mix16(p + 48, s + 96);
+					acc += mix16(p + len - 64, s + 112);
+				}
+				acc += mix16(p + 32, s + 64);
+				acc += mix16(p + len - 48, s + 80);
+			}
+			acc += mix16(p + 16, s + 32);
+			acc += mix16(p + len - 32, s + 48);
+		}
+		acc += mix16(p, s);
+		acc += mix16(p + len - 16, s + 16);
+		return xxh3_avalanche(acc);
+	}
+	for (size_t i = 0; i < 8; ++i)
+		acc += mix16(p + 16 * i, s + 16 * i);
+	acc = xxh3_avalanche(acc);
+	for (size_t i = 8; i < len / 16; ++i)
+		acc += mix16(p + 16 * i, s + 16 * (i - 8) + 3);
+	acc += mix16(p + len - 16, s + 136 - 17);
+	return xxh3_avalanche(acc);
+}
+
+// Eight independent lanes per stripe; plain loops the compiler vectorises.
+static inline void accumulate_stripe(uint64_t* acc, const uint8_t* p, const uint8_t* s)
+{
+	for (size_t i = 0; i < 8; ++i)
+	{
+		uint64_t v = read64(p + 8 * i);
+		uint64_t key = v ^ read64(s + 8 * i);
+		acc[i ^ 1] += v;
+		acc[i] += (uint64_t)(uint32_t)key * (key >> 32);
+	}
+}
+
+static inline void scramble(uint64_t* acc, const uint8_t* s)
+{
+	for (size_t i = 0; i < 8; ++i)
+	{
+		uint64_t a = acc[i];
+		a ^= a >> 47;
+		a ^= read64(s + 8 * i);
+		acc[i] = a * PRIME32_1;
+	}
+}
+
+bool ContentHash::kind_from_name(const std::string& name, Kind& kind)
+{
+	static const Kind kinds[] = { NONE, XXH3, SHA256, FNV1A64 };
+	for (Kind c : kinds)
+	{
+		if (name == ContentHash::name(c))
+		{
+			kind = c;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* ContentHash::name(Kind kind)
+{
+	switch (kind)
+	{
+		case XXH3:
+			return "xxh3";
+		case SHA256:
+			return "sha256";
+		case FNV1A64:
+			return "fnv1a64";
+		default:
+			return "none";
+	}
+}
+
+ContentHash::ContentHash(Kind kind) : k(kind)
+{
+	switch (k)
+	{
+		case XXH3:
+			x = new Xxh3;
+			break;
+		case SHA256:
+			sha = EVP_MD_CTX_new();
+			if (!sha || EVP_DigestInit_ex(sha, EVP_sha256(), nullptr) != 1)
+			{
+				log_error("SHA-256 context setup failed");
+				EVP_MD_CTX_free(sha);
+				sha = nullptr;
+			}
+			break;
+		case FNV1A64:
+			fnv = FNV_OFFSET;
+			break;
+		default:
+			break;
+	}
+}
+
+ContentHash::~ContentHash()
+{
+	delete x;
+	EVP_MD_CTX_free(sha);
+}
+
+void ContentHash::update(const void* data, size_t len)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	switch (k)
+	{
+		case XXH3:
+			xxh3_update(p, len);
+			break;
+		case SHA256:
+			if (sha)
+				EVP_DigestUpdate(sha, p, len);
+			break;
+		case FNV1A64:
+		{
+			uint64_t h = fnv;
+			for (size_t i = 0; i < len; ++i)
+			{
+				h ^= p[i];
+				h *= FNV_PRIME;
+			}
+			fnv = h;
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+std::string ContentHash::hex()
+{
+	char out[2 * EVP_MAX_MD_SIZE + 1];
+	out[0] = '\0';
+	switch (k)
+	{
+		case XXH3:
+			std::snprintf(out, sizeof(out), "%016llx", (unsigned long long)xxh3_digest());
+			break;
+		case SHA256:
+		{
+			uint8_t md[EVP_MAX_MD_SIZE];
+			unsigned int n = 0;
+			if (!sha || EVP_DigestFinal_ex(sha, md, &n) != 1)
+				return "";
+			for (unsigned int i = 0; i < n; ++i)
+				std::snprintf(out + 2 * i, 3, "%02x", md[i]);
+			EVP_MD_CTX_free(sha);
+			sha = nullptr;
+			break;
+		}
+		case FNV1A64:
+			std::snprintf(out, sizeof(out), "%016llx", (unsigned long long)fnv);
+			break;
+		default:
+			break;
+	}
+	return out;
+}
+
+void ContentHash::xxh3_update(const uint8_t* p, size_t n)
+{
+	uint64_t before = x->total;
+	x->total += n;
+	if (before + n <= SHORT_MAX)
+	{
+		std::memcpy(x->head + before, p, n);
+		return;
+	}
+	if (before <= SHORT_MAX)
+	{
+		static const uint64_t init[8] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+		std::memcpy(x->acc, init, sizeof(init));
+		xxh3_long(x->head, (size_t)before);
+	}
+	xxh3_long(p, n);
+}
+
+void ContentHash::xxh3_long(const uint8_t* p, size_t n)
+{
+	Xxh3& st = *x;
+	auto consume = [&st](const uint8_t* stripe)
+	{
+		accumulate_stripe(st.acc, stripe, SECRET + 8 * st.stripes);
+		if (++st.stripes == STRIPES_PER_BLOCK)
+		{
+			scramble(st.acc, SECRET + sizeof(SECRET) - STRIPE);
+			st.stripes = 0;
+		}
+	};
+	while (n > 0)
+	{
+		if (st.buffered == STRIPE)
+		{
+			consume(st.buf); // more input follows, so it is not the final stripe
+			std::memcpy(st.last, st.buf, STRIPE);
+			st.buffered = 0;
+		}
+		if (st.buffered == 0 && n > STRIPE)
+		{
+			while (n > STRIPE)
+			{
+				consume(p);
+				p += STRIPE;
+				n -= STRIPE;
+			}
+			std::memcpy(st.last, p - STRIPE, STRIPE);
+			continue;
+		}
+		size_t take = STRIPE - st.buffered < n ? STRIPE - st.buffered : n;
+		std::memcpy(st.buf + st.buffered, p, take);
+		st.buffered += take;
+		p += take;
+		n -= take;
+	}
+}
+
+uint64_t ContentHash::xxh3_digest() const
+{
+	if (x->total <= SHORT_MAX)
+		return xxh3_short(x->head, (size_t)x->total);
+	uint64_t acc[8];
+	std::memcpy(acc, x->acc, sizeof(acc));
+	uint8_t tail[STRIPE]; // the input's final 64 bytes
+	const uint8_t* final_stripe = x->buf;
+	if (x->buffered < STRIPE)
+	{
+		size_t from_last = STRIPE - x->buffered;
+		std::memcpy(tail, x->last + x->buffered, from_last);
+		std::memcpy(tail + from_last, x->buf, x->buffered);
+		final_stripe = tail;
+	}
+	accumulate_stripe(acc, final_stripe, SECRET + sizeof(SECRET) - STRIPE - 7);
+	uint64_t h = x->total * PRIME64_1;
+	for (size_t i = 0; i < 4; ++i)
+		h += mul128_fold64(acc[2 * i] ^ read64(SECRET + 11 + 16 * i), acc[2 * i + 1] ^ read64(SECRET + 11 + 16 * i + 8));
+	return xxh3_avalanche(h);
+}
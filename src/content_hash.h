@@ -0,0 +1,64 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+// Streaming digest of an upload, fed chunk by chunk as the data is written.
+// XXH3 is the 64-bit XXH3 (seed 0, default secret), the same value xxhsum -H3
+// prints; it works on 64-byte stripes of independent 64-bit lanes, which the
+// compiler turns into vector code. SHA-256 goes through OpenSSL for content
+// addressing, FNV-1a 64 is the old byte-at-a-time hash kept for compatibility.
+class ContentHash
+{
+  public:
+	enum Kind
+	{
+		NONE,
+		XXH3,
+		SHA256,
+		FNV1A64
+	};
+
+	// "xxh3", "sha256", "fnv1a64" or "none"; false for anything else.
+	static bool kind_from_name(const std::string& name, Kind& kind);
+	static const char* name(Kind kind);
+
+	explicit ContentHash(Kind kind);
+	~ContentHash();
+	ContentHash(const ContentHash&) = delete;
+	ContentHash& operator=(const ContentHash&) = delete;
+
+	Kind kind() const { return k; }
+	void update(const void* data, size_t len);
+	// Lower-case hex digest of everything fed so far; ends the stream.
+	std::string hex();
+
+  private:
+	// XXH3 input is consumed in stripes only once more data follows them, so the
+	// final stripe is always at hand for the finishing round.
+	struct Xxh3
+	{
+		uint64_t acc[8];
+		uint8_t head[240]; // inputs up to 240 bytes take the short path
+		uint8_t buf[64]; // stripe being filled
+		uint8_t last[64]; // previous stripe, for a final stripe shorter than 64
+		size_t buffered = 0;
+		size_t stripes = 0; // stripes accumulated in the current block
+		uint64_t total = 0;
+	};
+
+	void xxh3_update(const uint8_t* p, size_t n);
+	void xxh3_long(const uint8_t* p, size_t n);
+	uint64_t xxh3_digest() const;
+
+	Kind k;
+	Xxh3* x = nullptr;
+	EVP_MD_CTX* sha = nullptr;
+	uint64_t fnv = 0;
+};
+
+#endif // CONTENT_HASH_H
@@ -31,18 +31,48 @@ bool DynamicString::reserve(size_t sz)
 
 DynamicVariable::DynamicVariable() = default;
 
-DynamicVariable::DynamicVariable(const DynamicVariable& other) : type(other.type)
+DynamicVariable::DynamicVariable(const DynamicVariable& other)
 {
+	assign_from(other);
+}
+
+DynamicVariable::DynamicVariable(DynamicVariable&& other) noexcept : resource(other.resource)
+{
+	take_from(other);
+}
+
+DynamicVariable::DynamicVariable(const allocator_type& alloc) : resource(alloc.resource())
+{
+}
+
+DynamicVariable::DynamicVariable(const DynamicVariable& other, const allocator_type& alloc) : resource(alloc.resource())
+{
+	assign_from(other);
+}
+
+DynamicVariable::DynamicVariable(DynamicVariable&& other, const allocator_type& alloc) : resource(alloc.resource())
+{
+	take_from(other);
+}
+
+DynamicVariable::~DynamicVariable()
+{
+	clear();
+}
+
+void DynamicVariable::assign_from(const DynamicVariable& other)
+{
+	type = other.type;
 	switch (type)
 	{
 		case STRING:
-			new (&data.s) std::string(other.data.s);
+			new (&data.s) String(other.data.s, resource);
 			break;
 		case OBJECT:
-			new (&data.o) std::unordered_map<std::string, DynamicVariable>(other.data.o);
+			new (&data.o) Object(other.data.o, resource);
 			break;
 		case ARRAY:
-			new (&data.a) std::vector<DynamicVariable>(other.data.a);
+			new (&data.a) Array(other.data.a, resource);
 			break;
 		case NUMBER:
 			data.num = other.data.num;
@@ -55,18 +85,21 @@ DynamicVariable::DynamicVariable(const DynamicVariable& other) : type(other.type
 	}
 }
 
-DynamicVariable::DynamicVariable(DynamicVariable&& other) noexcept : type(other.type)
+// The allocator-extended move constructors move when the resources are equal
+// and copy element by element into ours when they are not.
+void DynamicVariable::take_from(DynamicVariable& other)
 {
+	type = other.type;
 	switch (type)
 	{
 		case STRING:
-			new (&data.s) std::string(std::move(other.data.s));
+			new (&data.s) String(std::move(other.data.s), resource);
 			break;
 		case OBJECT:
-			new (&data.o) std::unordered_map<std::string, DynamicVariable>(std::move(other.data.o));
+			new (&data.o) Object(std::move(other.data.o), resource);
 			break;
 		case ARRAY:
-			new (&data.a) std::vector<DynamicVariable>(std::move(other.data.a));
+			new (&data.a) Array(std::move(other.data.a), resource);
 			break;
 		case NUMBER:
 			data.num = other.data.num;
@@ -77,27 +110,30 @@ DynamicVariable::DynamicVariable(DynamicVariable&& other) noexcept : type(other.
 		case NIL:
 			break;
 	}
-	other.type = NIL;
+	other.clear();
 }
 
-DynamicVariable::~DynamicVariable()
+void DynamicVariable::assign_string(std::string_view str)
 {
+	if (type == STRING)
+	{
+		data.s.assign(str.data(), str.size());
+		return;
+	}
 	clear();
+	type = STRING;
+	new (&data.s) String(str, resource);
 }
 
 DynamicVariable::DynamicVariable(const char* lit)
 {
 	if (lit)
-	{
-		type = STRING;
-		new (&data.s) std::string(lit);
-	}
+		assign_string(lit);
 }
 
 DynamicVariable::DynamicVariable(std::string str)
 {
-	type = STRING;
-	new (&data.s) std::string(std::move(str));
+	assign_string(str);
 }
 
 DynamicVariable::DynamicVariable(double v)
@@ -118,11 +154,10 @@ DynamicVariable::DynamicVariable(bool v)
 	data.b = v;
 }
 
-DynamicVariable DynamicVariable::make_string(std::string v)
+DynamicVariable DynamicVariable::make_string(std::string_view v)
 {
 	DynamicVariable d;
-	d.type = STRING;
-	new (&d.data.s) std::string(std::move(v));
+	d.assign_string(v);
 	return d;
 }
 
@@ -146,7 +181,7 @@ DynamicVariable DynamicVariable::make_object()
 {
 	DynamicVariable d;
 	d.type = OBJECT;
-	new (&d.data.o) std::unordered_map<std::string, DynamicVariable>();
+	new (&d.data.o) Object(d.resource);
 	return d;
 }
 
@@ -154,7 +189,7 @@ DynamicVariable DynamicVariable::make_array()
 {
 	DynamicVariable d;
 	d.type = ARRAY;
-	new (&d.data.a) std::vector<DynamicVariable>();
+	new (&d.data.a) Array(d.resource);
 	return d;
 }
 
@@ -168,13 +203,13 @@ void DynamicVariable::clear()
 	switch (type)
 	{
 		case STRING:
-			data.s.~basic_string();
+			data.s.~String();
 			break;
 		case OBJECT:
-			data.o.~unordered_map();
+			data.o.~Object();
 			break;
 		case ARRAY:
-			data.a.~vector();
+			data.a.~Array();
 			break;
 		case NUMBER:
 		case BOOL:
@@ -185,15 +220,17 @@ void DynamicVariable::clear()
 	data.num = 0.0; // Reset payload
 }
 
-DynamicVariable& DynamicVariable::operator[](const std::string& key)
+DynamicVariable& DynamicVariable::operator[](std::string_view key)
 {
 	if (type != OBJECT)
 	{
 		clear();
 		type = OBJECT;
-		new (&data.o) std::unordered_map<std::string, DynamicVariable>();
+		new (&data.o) Object(resource);
 	}
-	return data.o[key];
+	if (DynamicVariable* v = find(key))
+		return *v;
+	return data.o.try_emplace(String(key, resource)).first->second;
 }
 
 DynamicVariable& DynamicVariable::operator=(const DynamicVariable& other)
@@ -201,27 +238,7 @@ DynamicVariable& DynamicVariable::operator=(const DynamicVariable& other)
 	if (this != &other)
 	{
 		clear();
-		type = other.type;
-		switch (type)
-		{
-			case STRING:
-				new (&data.s) std::string(other.data.s);
-				break;
-			case OBJECT:
-				new (&data.o) std::unordered_map<std::string, DynamicVariable>(other.data.o);
-				break;
-			case ARRAY:
-				new (&data.a) std::vector<DynamicVariable>(other.data.a);
-				break;
-			case NUMBER:
-				data.num = other.data.num;
-				break;
-			case BOOL:
-				data.b = other.data.b;
-				break;
-			case NIL:
-				break;
-		}
+		assign_from(other);
 	}
 	return *this;
 }
@@ -231,53 +248,32 @@ DynamicVariable& DynamicVariable::operator=(DynamicVariable&& other) noexcept
 	if (this != &other)
 	{
 		clear();
-		type = other.type;
-		switch (type)
-		{
-			case STRING:
-				new (&data.s) std::string(std::move(other.data.s));
-				break;
-			case OBJECT:
-				new (&data.o) std::unordered_map<std::string, DynamicVariable>(std::move(other.data.o));
-				break;
-			case ARRAY:
-				new (&data.a) std::vector<DynamicVariable>(std::move(other.data.a));
-				break;
-			case NUMBER:
-				data.num = other.data.num;
-				break;
-			case BOOL:
-				data.b = other.data.b;
-				break;
-			case NIL:
-				break;
-		}
-		other.clear();
+		take_from(other);
 	}
 	return *this;
 }
 
 DynamicVariable& DynamicVariable::operator=(const std::string& str)
 {
-	clear();
-	type = STRING;
-	new (&data.s) std::string(str);
+	assign_string(str);
 	return *this;
 }
 
 DynamicVariable& DynamicVariable::operator=(std::string&& str)
 {
-	clear();
-	type = STRING;
-	new (&data.s) std::string(std::move(str));
+	assign_string(str); // copied: the string's buffer is not from our resource
+	return *this;
+}
+
+DynamicVariable& DynamicVariable::operator=(std::string_view str)
+{
+	assign_string(str);
 	return *this;
 }
 
 DynamicVariable& DynamicVariable::operator=(const char* lit)
 {
-	clear();
-	type = STRING;
-	new (&data.s) std::string(lit ? lit : "");
+	assign_string(lit ? lit : "");
 	return *this;
 }
 
@@ -309,15 +305,24 @@ DynamicVariable& DynamicVariable::operator=(std::initializer_list<DynamicVariabl
 {
 	clear();
 	type = ARRAY;
-	new (&data.a) std::vector<DynamicVariable>(list.begin(), list.end());
+	new (&data.a) Array(list.begin(), list.end(), resource);
 	return *this;
 }
 
-DynamicVariable* DynamicVariable::find(std::string key)
+DynamicVariable* DynamicVariable::find(std::string_view key)
+{
+	return const_cast<DynamicVariable*>(static_cast<const DynamicVariable&>(*this).find(key));
+}
+
+// The lookup key is built on the stack rather than in our resource, which would
+// keep it until the arena is reset.
+const DynamicVariable* DynamicVariable::find(std::string_view key) const
 {
 	if (type != OBJECT)
 		return nullptr;
-	auto it = data.o.find(key);
+	char buf[256];
+	std::pmr::monotonic_buffer_resource scratch(buf, sizeof(buf));
+	auto it = data.o.find(String(key, &scratch));
 	return it == data.o.end() ? nullptr : &it->second;
 }
 
@@ -328,7 +333,7 @@ void DynamicVariable::push(DynamicVariable v)
 		if (type == NIL)
 		{
 			type = ARRAY;
-			new (&data.a) std::vector<DynamicVariable>();
+			new (&data.a) Array(resource);
 		}
 		else
 			return;
@@ -341,7 +346,7 @@ std::string DynamicVariable::to_string() const
 	switch (type)
 	{
 		case STRING:
-			return data.s;
+			return std::string(data.s);
 		case NUMBER:
 			return std::to_string(data.num);
 		case BOOL:
@@ -369,7 +374,7 @@ bool DynamicVariable::to_bool(bool def_value) const
 
 struct JsonCursor
 {
-	const std::string* s;
+	const std::string_view* s;
 	size_t i = 0;
 };
 
@@ -517,7 +522,7 @@ bool parse_number(JsonCursor& c, double& num)
 	}
 	try
 	{
-		num = std::stod(c.s->substr(start, c.i - start));
+		num = std::stod(std::string(c.s->substr(start, c.i - start)));
 	}
 	catch (...)
 	{
@@ -536,7 +541,7 @@ bool parse_array(JsonCursor& c, DynamicVariable& out)
 	}
 	out.clear();
 	out.type = DynamicVariable::ARRAY;
-	new (&out.data.a) std::vector<DynamicVariable>();
+	new (&out.data.a) DynamicVariable::Array(out.resource);
 	skip_ws(c);
 	if (match(c, ']'))
 	{
@@ -544,7 +549,7 @@ bool parse_array(JsonCursor& c, DynamicVariable& out)
 	}
 	while (true)
 	{
-		DynamicVariable elem;
+		DynamicVariable elem(out.get_allocator()); // moved, not copied, into out
 		if (!parse_value(c, elem))
 		{
 			return false;
@@ -570,7 +575,7 @@ bool parse_object(JsonCursor& c, DynamicVariable& out)
 	}
 	out.clear();
 	out.type = DynamicVariable::OBJECT;
-	new (&out.data.o) std::unordered_map<std::string, DynamicVariable>();
+	new (&out.data.o) DynamicVariable::Object(out.resource);
 	skip_ws(c);
 	if (match(c, '}'))
 	{
@@ -587,12 +592,12 @@ bool parse_object(JsonCursor& c, DynamicVariable& out)
 		{
 			return false;
 		}
-		DynamicVariable val;
+		DynamicVariable val(out.get_allocator());
 		if (!parse_value(c, val))
 		{
 			return false;
 		}
-		out.data.o.emplace(std::move(key), std::move(val));
+		out.data.o.emplace(DynamicVariable::String(key, out.resource), std::move(val));
 		skip_ws(c);
 		if (match(c, '}'))
 		{
@@ -658,7 +663,7 @@ bool parse_value(JsonCursor& c, DynamicVariable& out)
 	return false;
 }
 
-bool parse_json(const std::string& text, DynamicVariable& out, size_t* error_pos)
+bool parse_json(std::string_view text, DynamicVariable& out, size_t* error_pos)
 {
 	JsonCursor c{ &text, 0 };
 	if (!parse_value(c, out))
@@ -676,7 +681,7 @@ bool parse_json(const std::string& text, DynamicVariable& out, size_t* error_pos
 	}
 	return true;
 }
-static void json_escape(const std::string& s, std::string& out)
+static void json_escape(std::string_view s, std::string& out)
 {
 	out.push_back('"');
 	for (char ch : s)
@@ -870,7 +875,7 @@ std::string print_r(const DynamicVariable& v, int indent)
 	return out;
 }
 
-void print_any_limited(std::ostringstream& oss, const DynamicVariable& v, size_t limit, int indent, int depth)
+void print_any_limited(std::ostream& oss, const DynamicVariable& v, size_t limit, int indent, int depth)
 {
 	auto ind = [&](int d)
 	{ oss << std::string(d * indent, ' '); };
@@ -1,11 +1,14 @@
 #ifndef DYNAMIC_VARIABLE_H
 #define DYNAMIC_VARIABLE_H
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <cstdint>
 #include <type_traits>
+#include <iosfwd>
 #include "memory.h"
 
 struct DynamicString
@@ -20,8 +23,18 @@ struct DynamicString
 	bool reserve(size_t sz);
 };
 
+// The containers allocate from the variable's memory resource: the heap by
+// default, the request arena for the members of a Request. Values created inside
+// an object or array share its resource. Assignment keeps the target's resource
+// and copies when the source's differs; copy construction starts out on the
+// default resource, so a copy may outlive the arena it was taken from.
 struct DynamicVariable
 {
+	using allocator_type = std::pmr::polymorphic_allocator<char>;
+	using String = std::pmr::string;
+	using Object = std::pmr::unordered_map<String, DynamicVariable>;
+	using Array = std::pmr::vector<DynamicVariable>;
+
 	enum Type
 	{
 		NIL,
@@ -34,9 +47,9 @@ struct DynamicVariable
 
 	union Data
 	{
-		std::string s;
-		std::unordered_map<std::string, DynamicVariable> o;
-		std::vector<DynamicVariable> a;
+		String s;
+		Object o;
+		Array a;
 		double num;
 		bool b;
 
@@ -44,48 +57,63 @@ struct DynamicVariable
 		~Data() {}
 	} data;
 
+	std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
 	DynamicVariable();
 	DynamicVariable(const DynamicVariable& other);
-	DynamicVariable(DynamicVariable&& other) noexcept;
+	DynamicVariable(DynamicVariable&& other) noexcept; // takes other's resource along
 	~DynamicVariable();
 
+	// allocator-extended forms, used by the containers for their elements
+	explicit DynamicVariable(const allocator_type& alloc);
+	DynamicVariable(const DynamicVariable& other, const allocator_type& alloc);
+	DynamicVariable(DynamicVariable&& other, const allocator_type& alloc);
+	allocator_type get_allocator() const { return resource; }
+
 	DynamicVariable(const char* lit);
 	DynamicVariable(std::string str);
 	DynamicVariable(double v);
 	DynamicVariable(int v);
 	DynamicVariable(bool v);
 
-	static DynamicVariable make_string(std::string v);
+	static DynamicVariable make_string(std::string_view v);
 	static DynamicVariable make_number(double v);
 	static DynamicVariable make_bool(bool v);
 	static DynamicVariable make_object();
 	static DynamicVariable make_array();
 	static DynamicVariable make_null();
 
-	void clear();
-	DynamicVariable& operator[](const std::string& key);
+	void clear(); // back to NIL; the resource stays
+	DynamicVariable& operator[](std::string_view key);
 
 	DynamicVariable& operator=(const DynamicVariable& other);
 	DynamicVariable& operator=(DynamicVariable&& other) noexcept;
 	DynamicVariable& operator=(const std::string& str);
 	DynamicVariable& operator=(std::string&& str);
+	DynamicVariable& operator=(std::string_view str);
 	DynamicVariable& operator=(const char* lit);
 	DynamicVariable& operator=(double v);
 	DynamicVariable& operator=(int v);
 	DynamicVariable& operator=(bool v);
 	DynamicVariable& operator=(std::initializer_list<DynamicVariable> list);
 
-	DynamicVariable* find(std::string key);
+	DynamicVariable* find(std::string_view key); // does not allocate for keys up to 256 bytes
+	const DynamicVariable* find(std::string_view key) const;
 	void push(DynamicVariable v);
 
 	std::string to_string() const;
 	double to_number(double def_value = 0.0) const;
 	bool to_bool(bool def_value = false) const;
+
+  private:
+	void assign_from(const DynamicVariable& other); // type must be NIL
+	void take_from(DynamicVariable& other); // type must be NIL; moves if the resources match
+	void assign_string(std::string_view str);
 };
 
-bool parse_json(const std::string& text, DynamicVariable& out, size_t* error_pos = nullptr);
+bool parse_json(std::string_view text, DynamicVariable& out, size_t* error_pos = nullptr);
 std::string to_json(const DynamicVariable& v, bool pretty = false, int indent = 0);
 std::string print_r(const DynamicVariable& v, int indent = 2);
-void print_any_limited(std::ostringstream& oss, const DynamicVariable& v, size_t limit, int indent, int depth = 0);
+void print_any_limited(std::ostream& oss, const DynamicVariable& v, size_t limit, int indent, int depth = 0);
 
 #endif
@@ -0,0 +1,71 @@
+#include "fair_queue.h"
+
+FairQueue::FairQueue()
+{
+	credit = classes[0].weight;
+}
+
+void FairQueue::set_weight(TaskClass cls, uint32_t weight)
+{
+	classes[cls].weight = weight ? weight : 1;
+	if (cls == current)
+		credit = classes[cls].weight; // restart the turn with the new weight
+}
+
+void FairQueue::push(TaskNode* n)
+{
+	Class& c = classes[n->task_class < TASK_CLASSES ? n->task_class : TASK_REQUEST];
+	size_t f = n->tenant % FLOWS;
+	Flow& flow = c.flows[f];
+	n->next = nullptr;
+	if (flow.tail)
+		flow.tail->next = n;
+	else
+	{
+		flow.head = n;
+		c.ring[(c.ring_head + c.ring_count) % FLOWS] = (uint16_t)f; // flow becomes active
+		++c.ring_count;
+	}
+	flow.tail = n;
+	++c.count;
+	++count;
+}
+
+TaskNode* FairQueue::pop()
+{
+	if (count == 0)
+		return nullptr;
+	while (true)
+	{
+		Class& c = classes[current];
+		if (c.count > 0 && credit > 0)
+		{
+			--credit;
+			return take(c);
+		}
+		current = (current + 1) % TASK_CLASSES;
+		credit = classes[current].weight;
+	}
+}
+
+// Head of the next active flow; the flow goes to the back of the ring if it has more.
+TaskNode* FairQueue::take(Class& c)
+{
+	size_t f = c.ring[c.ring_head];
+	c.ring_head = (c.ring_head + 1) % FLOWS;
+	--c.ring_count;
+	Flow& flow = c.flows[f];
+	TaskNode* n = flow.head;
+	flow.head = n->next;
+	if (flow.head)
+	{
+		c.ring[(c.ring_head + c.ring_count) % FLOWS] = (uint16_t)f;
+		++c.ring_count;
+	}
+	else
+		flow.tail = nullptr;
+	n->next = nullptr;
+	--c.count;
+	--count;
+	return n;
+}
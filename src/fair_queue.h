@@ -0,0 +1,50 @@
+#ifndef FAIR_QUEUE_H
+#define FAIR_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "task.h"
+
+// Task order for the worker pool. Classes take turns by weighted round robin:
+// each turn serves up to its weight in tasks. Within a class, tenants hash into
+// FLOWS flows that are served one task at a time (stochastic fair queueing), so
+// a busy tenant waits behind its own backlog instead of everybody else's. Not
+// thread-safe; never allocates.
+class FairQueue
+{
+  public:
+	static const size_t FLOWS = 64;
+
+	FairQueue();
+
+	void set_weight(TaskClass cls, uint32_t weight); // 0 counts as 1
+	void push(TaskNode* n);
+	TaskNode* pop(); // nullptr when empty
+	size_t size() const { return count; }
+
+  private:
+	struct Flow
+	{
+		TaskNode* head = nullptr;
+		TaskNode* tail = nullptr;
+	};
+
+	struct Class
+	{
+		Flow flows[FLOWS];
+		uint16_t ring[FLOWS]; // flows with tasks, in serving order
+		size_t ring_head = 0;
+		size_t ring_count = 0;
+		size_t count = 0;
+		uint32_t weight = 1;
+	};
+
+	TaskNode* take(Class& c);
+
+	Class classes[TASK_CLASSES];
+	size_t current = 0; // class whose turn it is
+	uint32_t credit = 0; // tasks left in that turn
+	size_t count = 0;
+};
+
+#endif // FAIR_QUEUE_H
@@ -1,5 +1,8 @@
 #include "fastcgi.h"
 #include "config.h" // for global_config limits
+#include "memory.h"
+#include "http.h"
+#include <cstdlib>
 #include <cstring>
 #include <arpa/inet.h>
 
@@ -65,6 +68,91 @@ namespace fcgi
 		append_record(out, FCGI_END_REQUEST, reqId, reinterpret_cast<uint8_t*>(&b), sizeof(b));
 	}
 
+	static void append_length(std::vector<uint8_t>& out, size_t len)
+	{
+		if (len < 0x80)
+		{
+			out.push_back((uint8_t)len);
+			return;
+		}
+		out.push_back((uint8_t)((len >> 24) | 0x80));
+		out.push_back((uint8_t)(len >> 16));
+		out.push_back((uint8_t)(len >> 8));
+		out.push_back((uint8_t)len);
+	}
+
+	// Answer FCGI_GET_VALUES with the variables we know; unknown names are left out.
+	// Every request holds an arena, so that bounds the requests. Connections are not
+	// capped, so FCGI_MAX_CONNS is left out as well rather than reported as a limit.
+	static void append_get_values_result(std::vector<uint8_t>& out, const uint8_t* p, const uint8_t* end)
+	{
+		size_t arenas = global_arena_manager.arenas.size();
+		size_t max_reqs = global_config.max_in_flight < arenas ? global_config.max_in_flight : arenas;
+		std::vector<uint8_t> body;
+		while (p < end)
+		{
+			size_t nameLen = decode_length(p, end);
+			size_t valueLen = decode_length(p, end);
+			if ((size_t)(end - p) < nameLen + valueLen)
+				break;
+			std::string name(reinterpret_cast<const char*>(p), nameLen);
+			p += nameLen + valueLen;
+			std::string value;
+			if (name == "FCGI_MAX_REQS")
+				value = std::to_string(max_reqs);
+			else if (name == "FCGI_MPXS_CONNS")
+				value = global_config.fcgi_multiplex ? "1" : "0";
+			else
+				continue;
+			append_length(body, name.size());
+			append_length(body, value.size());
+			body.insert(body.end(), name.begin(), name.end());
+			body.insert(body.end(), value.begin(), value.end());
+		}
+		if (body.size() > 0xFFFF)
+			body.clear();
+		append_record(out, FCGI_GET_VALUES_RESULT, 0, body.data(), (uint16_t)body.size());
+	}
+
+	// True if some request on the connection has none of the given flags set.
+	static bool any_request_lacking(const RequestTable& requests, uint64_t flags)
+	{
+		for (Request* r : requests)
+			if (!(r->flags & flags))
+				return true;
+		return false;
+	}
+
+	// A multipart/form-data body is fed to the parser record by record, so uploads
+	// reach their temp files while the rest is still in transit. Only when the body
+	// has not started yet; otherwise it is parsed from r.body by the worker.
+	static void start_multipart(Request& r)
+	{
+		const DynamicVariable* ct = r.env.find("CONTENT_TYPE");
+		if (r.body_bytes != 0 || !ct || ct->type != DynamicVariable::STRING)
+			return;
+		std::string boundary = multipart_form_boundary(ct->data.s);
+		if (!boundary.empty())
+			r.multipart.reset(new MultipartParser(boundary, global_config.upload_tmp_dir));
+	}
+
+	// The arena was taken at BEGIN_REQUEST, before CONTENT_LENGTH was known. If
+	// its class is smaller than the one the body calls for, chain the difference
+	// on now in one block rather than piecemeal as the request fills it.
+	static void reserve_arena(Request& r)
+	{
+		const DynamicVariable* cl = r.env.find("CONTENT_LENGTH");
+		if (!r.arena || !cl || cl->type != DynamicVariable::STRING)
+			return;
+		size_t len = (size_t)std::strtoull(cl->data.s.c_str(), nullptr, 10);
+		if (len > global_config.body_memory_limit)
+			len = global_config.body_memory_limit; // the rest is spilled to disk
+		size_t want = global_arena_manager.class_capacity(global_arena_manager.class_for(sizeof(Request) + len));
+		if (want > r.arena->capacity)
+			r.arena->reserve(want - r.arena->capacity);
+		r.body.reserve(len); // the in-memory body is in the arena too; no regrowth copies
+	}
+
 	static void fail_request(Request& r, std::vector<uint8_t>& out_buf, uint8_t status)
 	{
 		if (!(r.flags & Request::RESPONDED))
@@ -72,21 +160,22 @@ namespace fcgi
 			append_end_request(out_buf, r.id, 0, status);
 			r.flags |= Request::RESPONDED;
 			r.flags |= Request::FAILED;
+			r.cancel.cancel(); // a handler still queued or running can stop
 		}
 	}
 
-	ProcessStatus process_buffer(std::vector<uint8_t>& in_buf, std::unordered_map<uint16_t, Request*>& requests, std::vector<uint8_t>& out_buf, Request* (*allocate_request)(uint16_t), void (*on_request_ready)(Request&), bool& waiting_for_arena)
+	ProcessStatus process_buffer(InputRing& in_buf, RequestTable& requests, std::vector<uint8_t>& out_buf, Request* (*allocate_request)(uint16_t), void (*on_request_ready)(Request&), bool& waiting_for_arena)
 	{
-		size_t offset = 0;
+		thread_local std::vector<uint8_t> scratch; // only used for records that wrap around the ring
 		bool close_needed = false;
 		const size_t max_params_bytes = global_config.max_params_bytes;
 		const size_t max_stdin_bytes = global_config.max_stdin_bytes;
 		while (true)
 		{
-			if (in_buf.size() - offset < sizeof(Header))
+			if (in_buf.size() < sizeof(Header))
 				break;
 			Header h;
-			std::memcpy(&h, in_buf.data() + offset, sizeof(h));
+			std::memcpy(&h, in_buf.peek(0, sizeof(h), scratch), sizeof(h));
 			if (h.version != VERSION_1)
 			{
 				close_needed = true;
@@ -95,55 +184,78 @@ namespace fcgi
 			uint16_t reqId = ntohs(h.requestId);
 			uint16_t contentLength = ntohs(h.contentLength);
 			size_t totalLen = sizeof(Header) + contentLength + h.paddingLength;
-			if (in_buf.size() - offset < totalLen)
+			if (in_buf.size() < totalLen)
 				break;
-			const uint8_t* content = in_buf.data() + offset + sizeof(Header);
-			auto current_req = [&](uint16_t id) -> Request*
+			const uint8_t* content = in_buf.peek(sizeof(Header), contentLength, scratch);
+			// records for IDs without an active request are ignored
+			Request* rptr = nullptr;
+			if (reqId == 0)
 			{
-				auto it = requests.find(id);
-				if (it == requests.end())
+				if (h.type == FCGI_GET_VALUES)
+					append_get_values_result(out_buf, content, content + contentLength);
+				else
 				{
-					Request* nr = allocate_request ? allocate_request(id) : nullptr;
-					if (!nr)
-						return nullptr;
-					requests[id] = nr;
-					return nr;
+					UnknownTypeBody ub{};
+					ub.type = h.type;
+					append_record(out_buf, FCGI_UNKNOWN_TYPE, 0, reinterpret_cast<uint8_t*>(&ub), sizeof(ub));
 				}
-				return it->second;
-			};
-			Request* rptr = nullptr;
+				in_buf.consume(totalLen);
+				continue;
+			}
 			switch (h.type)
 			{
 				case FCGI_BEGIN_REQUEST:
 				{
-					if (contentLength >= sizeof(BeginRequestBody))
+					if (contentLength < sizeof(BeginRequestBody))
+						break;
+					if (Request* prev = requests.find(reqId))
 					{
-						BeginRequestBody br{};
-						std::memcpy(&br, content, sizeof(br));
-						if (Request* nr = current_req(reqId))
-						{
-							rptr = nr;
-							nr->flags |= Request::INITIALIZED;
-							if (br.flags & KEEP_CONN)
-								nr->flags |= Request::KEEP_CONNECTION;
-						}
-						else
-						{
-							waiting_for_arena = true;
-							close_needed = false;
-							return close_needed ? CLOSE : OK;
-						}
+						if (prev->flags & Request::RESPONDED)
+							return close_needed ? CLOSE : OK; // ID reused before the old request was released; resume after
+						break; // duplicate BEGIN for a live request
 					}
+					BeginRequestBody br{};
+					std::memcpy(&br, content, sizeof(br));
+					if (!global_config.fcgi_multiplex && any_request_lacking(requests, Request::RESPONDED))
+					{
+						append_end_request(out_buf, reqId, 0, CANT_MPX_CONN);
+						break;
+					}
+					if (ntohs(br.role) != RESPONDER)
+					{
+						append_end_request(out_buf, reqId, 0, UNKNOWN_ROLE);
+						break;
+					}
+					Request* nr = allocate_request ? allocate_request(reqId) : nullptr;
+					if (!nr && any_request_lacking(requests, Request::RESPONDED | Request::INPUT_COMPLETE))
+					{
+						// waiting would also hold back the input of requests already running here
+						append_end_request(out_buf, reqId, 0, OVERLOADED);
+						break;
+					}
+					if (!nr)
+					{
+						waiting_for_arena = true; // the record stays in in_buf until an arena frees up
+						return OK;
+					}
+					requests.insert(reqId, nr);
+					rptr = nr;
+					nr->flags |= Request::INITIALIZED;
+					if (br.flags & KEEP_CONN)
+						nr->flags |= Request::KEEP_CONNECTION;
 					break;
 				}
 				case FCGI_PARAMS:
 				{
-					if (Request* r = current_req(reqId))
+					if (Request* r = requests.find(reqId))
 					{
 						rptr = r;
 						if (contentLength == 0)
 						{
 							r->flags |= Request::PARAMS_COMPLETE;
+							r->body_limit = request_body_limit(*r);
+							reserve_arena(*r);
+							start_multipart(*r);
 						}
 						else if (!(r->flags & Request::FAILED))
 						{
@@ -162,11 +274,11 @@ namespace fcgi
 									fail_request(*r, out_buf, OVERLOADED);
 									break;
 								}
-								std::string name(reinterpret_cast<const char*>(p), nameLen);
+								std::string_view name(reinterpret_cast<const char*>(p), nameLen);
 								p += nameLen;
-								std::string value(reinterpret_cast<const char*>(p), valueLen);
+								std::string_view value(reinterpret_cast<const char*>(p), valueLen);
 								p += valueLen;
-								r->env[name] = DynamicVariable::make_string(std::move(value));
+								r->env[name] = value; // both copied straight into the request arena
 								r->params_bytes += nameLen + valueLen;
 							}
 						}
@@ -178,7 +290,7 @@ namespace fcgi
 				}
 				case FCGI_STDIN:
 				{
-					if (Request* r = current_req(reqId))
+					if (Request* r = requests.find(reqId))
 					{
 						rptr = r;
 						if (contentLength == 0)
@@ -187,13 +299,20 @@ namespace fcgi
 						}
 						else if (!(r->flags & Request::FAILED))
 						{
-							if (r->body_bytes + contentLength > max_stdin_bytes)
+							if (r->body_bytes + contentLength > (r->body_limit ? r->body_limit : max_stdin_bytes))
 							{
 								fail_request(*r, out_buf, OVERLOADED);
 							}
+							else if (r->multipart)
+							{
+								r->multipart->feed(content, contentLength);
+								r->body_bytes += contentLength;
+								if (r->multipart->fields_too_large())
+									fail_request(*r, out_buf, OVERLOADED);
+							}
 							else
 							{
-								r->body.insert(r->body.end(), content, content + contentLength);
+								r->body.append(content, contentLength);
 								r->body_bytes += contentLength;
 							}
 						}
@@ -205,7 +324,7 @@ namespace fcgi
 				}
 				case FCGI_ABORT_REQUEST:
 				{
-					if (Request* r = current_req(reqId))
+					if (Request* r = requests.find(reqId))
 					{
 						rptr = r;
 						r->flags |= Request::ABORTED;
@@ -218,7 +337,7 @@ namespace fcgi
 					break;
 				}
 			}
-			offset += totalLen;
+			in_buf.consume(totalLen);
 			if (rptr && !(rptr->flags & Request::FAILED) && !(rptr->flags & Request::RESPONDED) &&
 				(rptr->flags & Request::PARAMS_COMPLETE) && (rptr->flags & Request::INPUT_COMPLETE))
 			{
@@ -226,8 +345,6 @@ namespace fcgi
 					on_request_ready(*rptr);
 			}
 		}
-		if (offset)
-			in_buf.erase(in_buf.begin(), in_buf.begin() + offset);
 		return close_needed ? CLOSE : OK;
 	}
 
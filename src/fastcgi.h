@@ -5,10 +5,11 @@
 #include <cstddef>
 #include <vector>
 #include <string>
-#include <unordered_map>
 #include "http.h"
 #include "dynamic_variable.h"
 #include "request.h"
+#include "iobuf.h"
+#include "request_table.h"
 
 namespace fcgi
 {
@@ -73,13 +74,25 @@ namespace fcgi
 		uint8_t reserved[3];
 	} __attribute__((packed));
 
+	struct UnknownTypeBody
+	{
+		uint8_t type;
+		uint8_t reserved[7];
+	} __attribute__((packed));
+
+	// largest possible record: header + 16-bit content length + 8-bit padding
+	static const size_t MAX_RECORD_SIZE = sizeof(Header) + 0xFFFF + 0xFF;
+
 	enum ProcessStatus
 	{
 		OK = 0,
 		CLOSE = 1
 	};
 
-	ProcessStatus process_buffer(std::vector<uint8_t>& in_buf, std::unordered_map<uint16_t, Request*>& requests, std::vector<uint8_t>& out_buf, Request* (*allocate_request)(uint16_t), void (*on_request_ready)(Request&), bool& waiting_for_arena);
+	// Parses complete records in place and consumes them from in_buf. Records for
+	// several request IDs may be interleaved; management records (ID 0) are answered
+	// directly into out_buf.
+	ProcessStatus process_buffer(InputRing& in_buf, RequestTable& requests, std::vector<uint8_t>& out_buf, Request* (*allocate_request)(uint16_t), void (*on_request_ready)(Request&), bool& waiting_for_arena);
 
 	void append_record(std::vector<uint8_t>& out, uint8_t type, uint16_t reqId, const uint8_t* data, uint16_t len);
 	void append_stdout_text(std::vector<uint8_t>& out, uint16_t reqId, const std::string& body);
@@ -8,18 +8,28 @@
 #include <cstring>
 #include <unordered_map>
 #include <deque>
+#include <algorithm>
 #include "fastcgi.h"
 #include "config.h"
 #include "logger.h"
 #include "http.h"
 #include "session.h"
 #include "memory.h"
+#include "affinity.h"
+#include "iobuf.h"
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <sys/stat.h>
 #include <sys/timerfd.h>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
 #include "worker.h"
+#include "uring.h"
+#include "timer_wheel.h"
+#include "mpsc_queue.h"
+#include "fileops.h"
 
 namespace fcgi_conn
 {
@@ -33,99 +43,302 @@ namespace fcgi_conn
 		return 0;
 	}
 
+	struct Reactor;
+
 	struct Connection
 	{
 		int fd = -1;
-		std::vector<uint8_t> in_buf;
-		std::vector<uint8_t> out_buf; // outbound data buffer (IO thread only)
-		size_t out_pos = 0; // bytes already sent from start of out_buf (IO thread only)
-		std::unordered_map<uint16_t, Request*> requests; // managed via arenas
+		Reactor* reactor = nullptr; // owning IO loop
+		InputRing in_buf; // allocated on first read
+		bool read_stalled = false; // ring full and parser blocked; socket not drained
+		OutputChain out; // outbound segments, flushed with sendmsg (IO thread only)
+		RequestTable requests; // managed via arenas
 		std::atomic<bool> closed{ false }; // accessed from IO + worker threads
 		bool waiting_for_arena = false; // BEGIN_REQUEST record deferred (legacy helper flag)
+		bool input_paused = false; // over the input budget: EPOLLIN dropped / recv not re-armed
+		bool had_request = false; // a request was started; until then the connection is not finished
+		bool close_when_done = false; // a request without FCGI_KEEP_CONN was released
+		TimerNode idle_timer; // idle_timeout, re-armed lazily from last_active_ms
+		uint64_t last_active_ms = 0;
+		size_t input_bytes = 0; // params + body bytes held by this connection's live requests
+		size_t input_draining = 0; // part of input_bytes in complete requests (freed once handled)
 		std::atomic<int> active_workers{ 0 };
 		uint32_t epoll_mask = EPOLLIN | EPOLLET; // currently registered interest mask
 		bool want_write_interest = false; // desired EPOLLOUT interest
+		// streamed responses: workers account what they queue, the IO thread what is still unsent
+		std::atomic<size_t> queued_bytes{ 0 }; // pushed by workers, not yet linked into out
+		std::atomic<size_t> out_backlog{ 0 }; // out.size() as last published by the IO thread
+		std::atomic<int> drain_waiters{ 0 };
+		std::mutex drain_mutex;
+		std::condition_variable drain_cv; // signalled when the backlog falls under the low-water mark
+#ifdef WASAPI_IO_URING
+		// io_uring backend only
+		unsigned ops_inflight = 0; // armed recv + queued sends; the fd is closed when this drops to 0
+		unsigned sends_inflight = 0;
+		bool recv_armed = false;
+		bool closing = false; // close requested, waiting for in-flight operations
+		std::vector<iovec> send_iov; // descriptors of the queued send chain
+		std::vector<msghdr> send_msgs;
+		std::vector<uint8_t> overflow; // received while the input ring was stalled
+#endif
+	};
+
+	enum TimerKind : uint16_t
+	{
+		TIMER_REQUEST = 1, // max_request_time, owner is the Request
+		TIMER_IDLE, // idle_timeout, owner is the Connection
+	};
+	static const uint32_t TIMER_TICK_MS = 100; // housekeeping interval and timer resolution
+	static const size_t INPUT_KEEP_BYTES = 16 * 1024; // input ring pages an idle connection keeps committed
+
+	// Records flushed by a ResponseWriter, waiting to be linked into the connection's chain.
+	// An entry without data and request marks a worker that has finished.
+	struct PendingChunk
+	{
+		Connection* conn = nullptr;
+		int fd = -1;
+		Request* req = nullptr;
+		std::vector<uint8_t> data;
+		bool last = false; // carries END_REQUEST
+		PendingChunk* next = nullptr; // MpscQueue link
+	};
+
+	// One epoll loop with its own connections, wakeup fds and completion queue.
+	// Each reactor runs on exactly one thread; only pending_output is touched by workers.
+	struct Reactor
+	{
+		size_t index = 0;
+		int epfd = -1;
+		int eventfd = -1; // signals IO thread about pending work
+		int timerfd = -1; // periodic housekeeping timer
+		int listen_fd = -1; // listening socket (own SO_REUSEPORT socket or shared unix socket)
+		bool shared_listen = false; // listen_fd is shared with other reactors (EPOLLEXCLUSIVE)
+		bool accept_paused = false; // whether accept() is currently paused (socket removed from epoll)
+		std::unordered_map<int, Connection> conns;
+		std::vector<int> close_queue; // deferred closes
+		MpscQueue<PendingChunk> pending_output; // response records flushed by workers
+		std::deque<int> waiting_conns; // connections waiting for arena allocation
+		std::deque<int> input_paused_conns; // connections waiting for input budget
+		TimerWheel timers{ TIMER_TICK_MS }; // request deadlines and idle connections
+		uint64_t now_ms = 0; // monotonic time, refreshed every tick
+#ifdef WASAPI_IO_URING
+		Uring* ring = nullptr; // io_uring backend when set, epoll otherwise
+		UringBufferGroup* recv_bufs = nullptr; // provided buffers for multishot recv
+		bool accept_armed = false; // multishot accept outstanding
+		uint64_t eventfd_value = 0; // read target for the eventfd
+		__kernel_timespec tick{}; // housekeeping interval
+#endif
 	};
 
-	static std::unordered_map<int, Connection> g_conns;
 	static RequestReadyCallback g_user_request_ready = nullptr;
-	static int g_epfd = -1; // epoll fd for worker-triggered wakeups
-	static int g_timerfd = -1; // periodic housekeeping timer
-	static std::vector<int> g_close_queue; // deferred closes
-	static std::vector<Request*> g_pending_output; // requests ready for output assembly
-	static std::mutex g_pending_output_mutex; // protects g_pending_output
-	static int g_listen_fd = -1; // current listening socket (for pausing/resuming accept)
-	static bool g_accept_paused = false; // whether accept() is currently paused (socket removed from epoll)
-	static std::deque<int> g_waiting_conns; // connections waiting for arena allocation
-
-	static void resume_accept(); // fwd
-	static void pause_accept(); // fwd
-	static int g_eventfd = -1; // signals IO thread about pending work
+
+	static void resume_accept(Reactor& R); // fwd
+	static void pause_accept(Reactor& R); // fwd
 	static Request* allocate_request(uint16_t id);
-	static void flush_connection(Connection& c, int epfd);
+	static void flush_connection(Connection& c);
 	static void internal_on_request_ready(Request& r);
 	static bool should_close_connection(Connection& c); // forward
 	static void finalize_request(Request& req); // forward (already defined later)
 	static void release_request(Request* r); // forward
-	static void maybe_update_epoll(Connection& c, int epfd, uint32_t desired); // forward
-	static void close_connection(int fd, int epfd); // forward
+	static void maybe_update_epoll(Connection& c, uint32_t desired); // forward
+	static void close_connection(Reactor& R, int fd); // forward
 	static void cleanup_connection_requests(Connection& c); // forward
 	static void process_fcgi(Connection& c); // forward
-	static inline void update_write_interest(Connection& c, int epfd, bool want);
-	static inline bool modify_listen_interest(bool add); // add/remove listen fd from epoll
+	static void read_input(Connection& c); // forward
+	static void release_finished_requests(Connection& c); // forward
+	static void process_close_queue(Reactor& R); // forward
+	static void after_io(Reactor& R, Connection& c); // forward
+	static inline void update_write_interest(Connection& c, bool want);
+	static inline bool modify_listen_interest(Reactor& R, bool add); // add/remove listen fd from epoll
+#ifdef WASAPI_IO_URING
+	enum UringOp : uint32_t
+	{
+		URING_ACCEPT = 1,
+		URING_RECV,
+		URING_SEND,
+		URING_EVENT,
+		URING_TIMER,
+		URING_CANCEL
+	};
+	static const unsigned URING_ENTRIES = 1024;
+	static const unsigned URING_RECV_BUFFERS = 256; // power of two, shared by all connections of a reactor
+	static const size_t URING_RECV_BUFFER_SIZE = 16 * 1024;
+	static const uint16_t URING_RECV_GROUP = 0;
+	static void uring_send(Connection& c);
+	static void uring_resume_input(Connection& c);
+	static void uring_close(Reactor& R, std::unordered_map<int, Connection>::iterator it);
+#endif
 	thread_local Connection* tls_io_connection = nullptr;
 
-	static void process_waiting_connections()
+	// Request input held in memory across all reactors, and the part of it that
+	// workers will free. Reading only pauses while something is draining, otherwise
+	// requests still receiving their body could never complete.
+	static std::atomic<size_t> g_input_bytes{ 0 };
+	static std::atomic<size_t> g_input_draining{ 0 };
+
+	// Recount this connection's share after its requests grew or were released.
+	static void account_input(Connection& c)
+	{
+		size_t held = 0, draining = 0;
+		for (Request* rp : c.requests)
+		{
+			size_t n = rp->params_bytes + rp->body.memory_bytes(); // spilled body bytes are on disk
+			size_t writing = rp->body.unwritten_bytes(); // copies queued for the file threads
+			if (!(rp->flags & Request::INPUT_COMPLETE) && rp->multipart)
+			{
+				n += rp->multipart->memory_bytes(); // the worker takes the parser over after that
+				writing += rp->multipart->unwritten_bytes();
+			}
+			held += n + writing;
+			if (rp->flags & Request::INPUT_COMPLETE)
+				draining += n;
+			draining += writing; // freed as the disk catches up
+		}
+		g_input_bytes.fetch_add(held - c.input_bytes, std::memory_order_relaxed); // unsigned wrap is the delta
+		g_input_draining.fetch_add(draining - c.input_draining, std::memory_order_relaxed);
+		c.input_bytes = held;
+		c.input_draining = draining;
+	}
+
+	static bool input_over_budget(const Connection& c)
+	{
+		auto& G = global_config;
+		if (G.max_conn_input_bytes && c.input_bytes > G.max_conn_input_bytes && c.input_draining > 0)
+			return true;
+		return G.max_input_bytes && g_input_bytes.load(std::memory_order_relaxed) > G.max_input_bytes && g_input_draining.load(std::memory_order_relaxed) > 0;
+	}
+
+	// Stop reading from c until the budget frees up; resume_paused_input picks it up.
+	static void pause_input(Connection& c)
+	{
+		if (c.input_paused)
+			return;
+		c.input_paused = true;
+		c.reactor->input_paused_conns.push_back(c.fd);
+		log_debug("Input paused fd=%d (held %zu, total %zu)", c.fd, c.input_bytes, g_input_bytes.load(std::memory_order_relaxed));
+#ifdef WASAPI_IO_URING
+		if (c.reactor->ring)
+		{
+			if (c.recv_armed)
+				c.reactor->ring->prep_cancel(uring_ud(URING_RECV, c.fd), uring_ud(URING_CANCEL, c.fd));
+			return;
+		}
+#endif
+		maybe_update_epoll(c, c.epoll_mask & ~(uint32_t)EPOLLIN);
+	}
+
+	static void resume_paused_input(Reactor& R)
+	{
+		size_t initial = R.input_paused_conns.size();
+		for (size_t i = 0; i < initial && !R.input_paused_conns.empty(); ++i)
+		{
+			int fd = R.input_paused_conns.front();
+			R.input_paused_conns.pop_front();
+			auto it = R.conns.find(fd);
+			if (it == R.conns.end())
+				continue; // connection gone
+			Connection& c = it->second;
+			if (c.closed.load(std::memory_order_relaxed))
+			{
+				c.input_paused = false;
+				continue;
+			}
+			account_input(c); // queued upload writes may have reached the disk since
+			if (input_over_budget(c))
+			{
+				R.input_paused_conns.push_back(fd);
+				continue;
+			}
+			c.input_paused = false;
+			log_debug("Input resumed fd=%d", fd);
+#ifdef WASAPI_IO_URING
+			if (!R.ring)
+#endif
+				maybe_update_epoll(c, c.epoll_mask | EPOLLIN);
+			read_input(c); // the socket was left undrained, no new edge will come
+			flush_connection(c);
+		}
+	}
+
+	static void process_waiting_connections(Reactor& R)
 	{
 		int budget = (int)global_arena_manager.available_count.load(std::memory_order_relaxed);
-		if (budget <= 0 || g_waiting_conns.empty())
+		if (budget <= 0 || R.waiting_conns.empty())
 			return;
-		size_t initial = g_waiting_conns.size();
-		for (size_t i = 0; i < initial && budget > 0 && !g_waiting_conns.empty(); ++i)
+		size_t initial = R.waiting_conns.size();
+		for (size_t i = 0; i < initial && budget > 0 && !R.waiting_conns.empty(); ++i)
 		{
-			int fd = g_waiting_conns.front();
-			g_waiting_conns.pop_front();
-			auto it = g_conns.find(fd);
-			if (it == g_conns.end())
+			int fd = R.waiting_conns.front();
+			R.waiting_conns.pop_front();
+			auto it = R.conns.find(fd);
+			if (it == R.conns.end())
 				continue; // connection gone
 			Connection& c = it->second;
 			if (c.closed.load(std::memory_order_relaxed))
 				continue; // will be closed soon
 			bool was_waiting = c.waiting_for_arena;
-			process_fcgi(c);
+			if (c.read_stalled)
+				read_input(c); // socket still holds data we could not buffer
+			else
+				process_fcgi(c);
 			if (was_waiting && !c.waiting_for_arena)
 			{
 				--budget;
-				flush_connection(c, g_epfd);
+				flush_connection(c);
 			}
 			else if (c.waiting_for_arena)
 			{
-				g_waiting_conns.push_back(fd);
+				R.waiting_conns.push_back(fd);
 			}
 		}
 	}
 
-	static inline void update_write_interest(Connection& c, int epfd, bool want)
+	static inline void update_write_interest(Connection& c, bool want)
 	{
-		uint32_t base = EPOLLIN | EPOLLET;
+#ifdef WASAPI_IO_URING
+		if (c.reactor->ring)
+		{
+			if (want)
+				uring_send(c);
+			return;
+		}
+#endif
+		uint32_t base = c.input_paused ? EPOLLET : (EPOLLIN | EPOLLET);
 		uint32_t desired = want ? (base | EPOLLOUT) : base;
 		bool have = (c.epoll_mask & EPOLLOUT) != 0;
 		if (have == want)
 			return;
-		maybe_update_epoll(c, epfd, desired);
+		maybe_update_epoll(c, desired);
 		c.want_write_interest = want;
 	}
 
-	static inline bool modify_listen_interest(bool add)
+	static inline bool modify_listen_interest(Reactor& R, bool add)
 	{
-		if (g_epfd == -1 || g_listen_fd == -1)
+#ifdef WASAPI_IO_URING
+		if (R.ring)
+		{
+			// the multishot accept stays armed until its final CQE, see uring_dispatch
+			uint64_t ud = uring_ud(URING_ACCEPT, R.listen_fd);
+			if (add && !R.accept_armed)
+			{
+				R.ring->prep_accept_multishot(R.listen_fd, ud);
+				R.accept_armed = true;
+			}
+			else if (!add && R.accept_armed)
+				R.ring->prep_cancel(ud, uring_ud(URING_CANCEL, -1));
+			return true;
+		}
+#endif
+		if (R.epfd == -1 || R.listen_fd == -1)
 			return false;
 		if (add)
 		{
 			epoll_event ev{};
-			ev.data.fd = g_listen_fd;
+			ev.data.fd = R.listen_fd;
 			ev.events = EPOLLIN | EPOLLET;
-			if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_listen_fd, &ev) == -1)
+			if (R.shared_listen)
+				ev.events |= EPOLLEXCLUSIVE; // wake only one reactor per incoming connection
+			if (epoll_ctl(R.epfd, EPOLL_CTL_ADD, R.listen_fd, &ev) == -1)
 			{
 				log_error("epoll_ctl ADD listen: %s", std::strerror(errno));
 				return false;
@@ -133,7 +346,7 @@ namespace fcgi_conn
 		}
 		else
 		{
-			if (epoll_ctl(g_epfd, EPOLL_CTL_DEL, g_listen_fd, nullptr) == -1)
+			if (epoll_ctl(R.epfd, EPOLL_CTL_DEL, R.listen_fd, nullptr) == -1)
 			{
 				log_error("epoll_ctl DEL listen: %s", std::strerror(errno));
 				return false;
@@ -147,9 +360,14 @@ namespace fcgi_conn
 		if (c.closed.load(std::memory_order_relaxed))
 			return;
 		bool waiting = false;
+		std::vector<uint8_t> control; // END_REQUEST records for rejected/aborted requests
 		tls_io_connection = &c;
-		auto status = fcgi::process_buffer(c.in_buf, c.requests, c.out_buf, allocate_request, internal_on_request_ready, waiting);
+		auto status = fcgi::process_buffer(c.in_buf, c.requests, control, allocate_request, internal_on_request_ready, waiting);
 		tls_io_connection = nullptr;
+		c.out.append(std::move(control));
+		if (!c.requests.empty())
+			c.had_request = true;
+		account_input(c);
 		if (status == fcgi::CLOSE)
 			c.closed.store(true, std::memory_order_relaxed);
 		c.waiting_for_arena = waiting;
@@ -158,77 +376,240 @@ namespace fcgi_conn
 		}
 	}
 
-	static void close_connection(int fd, int epfd)
+	static void close_connection(Reactor& R, int fd)
 	{
-		auto it = g_conns.find(fd);
-		if (it == g_conns.end())
+		auto it = R.conns.find(fd);
+		if (it == R.conns.end())
 			return;
+#ifdef WASAPI_IO_URING
+		if (R.ring)
+		{
+			uring_close(R, it);
+			return;
+		}
+#endif
 		Connection& c = it->second;
 		cleanup_connection_requests(c);
-		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+		R.timers.cancel(c.idle_timer);
+		epoll_ctl(R.epfd, EPOLL_CTL_DEL, fd, nullptr);
 		::close(fd);
 		log_debug("Closed fd=%d", fd);
-		g_conns.erase(it);
+		R.conns.erase(it);
 	}
 
 	static void cleanup_connection_requests(Connection& c)
 	{
-		for (auto& rk : c.requests)
+		for (Request* rp : c.requests)
 		{
-			if (rk.second)
-			{
-				if (!(rk.second->flags & Request::RESPONDED))
-					finalize_request(*rk.second);
-				release_request(rk.second);
-			}
+			if (!(rp->flags & Request::RESPONDED))
+				finalize_request(*rp);
+			release_request(rp);
 		}
 		c.requests.clear();
+		account_input(c);
+	}
+
+	static bool connection_idle(const Connection& c)
+	{
+		return c.requests.empty() && c.out.empty() && !c.waiting_for_arena && !c.read_stalled && !c.input_paused &&
+			   c.active_workers.load(std::memory_order_acquire) == 0 && c.queued_bytes.load(std::memory_order_acquire) == 0;
+	}
+
+	static void start_idle_timer(Reactor& R, Connection& c)
+	{
+		c.last_active_ms = R.now_ms;
+		if (global_config.idle_timeout <= 0)
+			return;
+		c.idle_timer.owner = &c;
+		c.idle_timer.kind = TIMER_IDLE;
+		R.timers.schedule(c.idle_timer, R.now_ms + (uint64_t)(global_config.idle_timeout * 1000));
+	}
+
+	static void on_request_timeout(Reactor& R, Request& r)
+	{
+		Connection* c = static_cast<Connection*>(r.conn_ptr);
+		if (!c || (r.flags & Request::RESPONDED))
+			return;
+		log_debug("Request %u timed out fd=%d", (unsigned)r.id, c->fd);
+		r.flags |= Request::FAILED;
+		r.flags |= Request::RESPONDED;
+		r.cancel.cancel();
+		std::vector<uint8_t> rec;
+		fcgi::append_end_request(rec, r.id, 0, fcgi::OVERLOADED);
+		c->out.append(std::move(rec));
+		flush_connection(*c);
+		after_io(R, *c); // released right away unless a worker still holds it
+	}
+
+	// Activity only stamps last_active_ms; the timer re-arms itself for the remainder.
+	static void on_idle_timeout(Reactor& R, Connection& c)
+	{
+		uint64_t limit = (uint64_t)(global_config.idle_timeout * 1000);
+		uint64_t due = c.last_active_ms + limit;
+		if (should_close_connection(c) || (due <= R.now_ms && connection_idle(c)))
+		{
+			log_debug("Closing idle fd=%d", c.fd);
+			close_connection(R, c.fd);
+			return;
+		}
+		R.timers.schedule(c.idle_timer, due > R.now_ms ? due : R.now_ms + limit);
+	}
+
+	static void on_timer(Reactor& R, TimerNode& t)
+	{
+		if (t.kind == TIMER_REQUEST)
+			on_request_timeout(R, *static_cast<Request*>(t.owner));
+		else if (t.kind == TIMER_IDLE)
+			on_idle_timeout(R, *static_cast<Connection*>(t.owner));
+	}
+
+	// Periodic tick: fire due timers, then the reactor-wide retries (accept, arenas, input budget).
+	static void housekeeping(Reactor& R)
+	{
+		R.now_ms = monotonic_ms();
+		R.timers.advance(R.now_ms, [&R](TimerNode& t)
+						 { on_timer(R, t); });
+		process_close_queue(R);
+		// arenas may have been freed by another reactor since we paused
+		if (R.accept_paused && global_arena_manager.available_count.load(std::memory_order_relaxed) > 0)
+			resume_accept(R);
+#ifdef WASAPI_IO_URING
+		else if (R.ring && !R.accept_paused)
+			modify_listen_interest(R, true); // re-arm after an accept error ended the multishot
+#endif
+		process_waiting_connections(R);
+		resume_paused_input(R); // the global budget may have been freed by another reactor
+	}
+
+	static void finalize_request(Request& req);
+
+	// Producers only call this when their push found the queue empty; the reactor
+	// clears the eventfd before draining, so no completion is left unsignalled.
+	static void wake_reactor(Reactor& R)
+	{
+		if (R.eventfd != -1)
+		{
+			uint64_t val = 1;
+			ssize_t wr = write(R.eventfd, &val, sizeof(val));
+			(void)wr; // best-effort wakeup
+		}
+	}
+
+	// Worker-side end of a streamed response: records go to the reactor's queue and
+	// the producer is throttled on what the connection has not sent yet.
+	struct ConnectionSink : ResponseSink
+	{
+		Connection& conn;
+		Request& req;
+
+		ConnectionSink(Connection& c, Request& r) : conn(c), req(r) {}
+
+		void push(std::vector<uint8_t>&& records, bool last) override
+		{
+			Reactor& R = *conn.reactor;
+			conn.queued_bytes.fetch_add(records.size(), std::memory_order_relaxed);
+			if (R.pending_output.push(new PendingChunk{ &conn, conn.fd, &req, std::move(records), last }))
+				wake_reactor(R);
+		}
+
+		size_t backlog() const override
+		{
+			return conn.queued_bytes.load(std::memory_order_relaxed) + conn.out_backlog.load(std::memory_order_relaxed);
+		}
+
+		bool wait_drained(size_t low) override
+		{
+			std::unique_lock<std::mutex> lk(conn.drain_mutex);
+			conn.drain_waiters.fetch_add(1, std::memory_order_relaxed);
+			while (backlog() > low && !conn.closed.load(std::memory_order_relaxed) && !req.cancel.cancelled())
+				conn.drain_cv.wait_for(lk, std::chrono::milliseconds(100)); // also notices closes and timeouts
+			conn.drain_waiters.fetch_sub(1, std::memory_order_relaxed);
+			return !conn.closed.load(std::memory_order_relaxed) && !req.cancel.cancelled();
+		}
+	};
+
+	// Publish how much output is still unsent and wake producers blocked in wait_drained.
+	static void publish_backlog(Connection& c)
+	{
+		c.out_backlog.store(c.out.size(), std::memory_order_relaxed);
+		if (c.drain_waiters.load(std::memory_order_relaxed) == 0)
+			return;
+		size_t low = global_config.response_high_water / 2;
+		if (c.out.size() + c.queued_bytes.load(std::memory_order_relaxed) <= low || c.closed.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> lk(c.drain_mutex);
+			c.drain_cv.notify_all();
+		}
 	}
 
-	static void housekeeping_close_idle(int epfd)
+	static bool request_live(Request* rp, Connection* cp)
 	{
-		std::vector<int> to_close;
-		to_close.reserve(g_conns.size());
-		for (auto& kv : g_conns)
+		return !rp->cancel.cancelled() && !(rp->flags & Request::RESPONDED) && !cp->closed.load(std::memory_order_relaxed);
+	}
+
+	// Whether preparing r may wait on the disk: spilled body or uploads to take
+	// over, or a session file to load. Such requests prepare on the blocking pool
+	// and only come back to the CPU pool for the handler.
+	static bool prepare_may_block(Request& r)
+	{
+		if (form_data_touches_disk(r))
+			return true;
+		if (!global_config.session_auto_load)
+			return false;
+		const DynamicVariable* cookies = r.env.find(global_config.http_cookies_var);
+		return cookies && cookies->type == DynamicVariable::STRING && cookies->data.s.find(global_config.session_cookie_name) != std::string::npos;
+	}
+
+	// Worker side, first stage: parse the input and load the session.
+	static void prepare_request(Request* rp, Connection* cp)
+	{
+		if (!request_live(rp, cp))
+			return;
+		parse_endpoint_file(*rp, rp->env.find(global_config.endpoint_file_path));
+		parse_cookie_header(*rp, rp->env.find(global_config.http_cookies_var));
+		parse_query_string(*rp, rp->env.find(global_config.http_query_var));
+		parse_form_data(*rp);
+		if (global_config.session_auto_load)
 		{
-			Connection& c = kv.second;
-			if (!c.requests.empty())
+			DynamicVariable* sid = rp->cookies.find(global_config.session_cookie_name);
+			if (sid && sid->type == DynamicVariable::STRING)
 			{
-				struct timespec ts;
-				clock_gettime(CLOCK_MONOTONIC, &ts);
-				double now = ts.tv_sec + ts.tv_nsec / 1e9;
-				for (auto& rk : c.requests)
-				{
-					Request* rp = rk.second;
-					if (!rp)
-						continue;
-					if (!(rp->flags & Request::RESPONDED) && global_config.max_request_time > 0 && (now - rp->start_time_sec) > global_config.max_request_time)
-					{
-						rp->flags |= Request::FAILED;
-						rp->flags |= Request::RESPONDED;
-						fcgi::append_end_request(c.out_buf, rp->id, 0, fcgi::OVERLOADED);
-					}
-				}
+				session_start(*rp);
 			}
-			if (should_close_connection(c))
-				to_close.push_back(kv.first);
 		}
-		for (int fd : to_close)
+		rp->headers["Content-Type"] = global_config.default_content_type;
+	}
+
+	// Worker side, second stage: run the handler and hand the request back.
+	static void handle_request(Request* rp, Connection* cp)
+	{
+		Reactor* R = cp->reactor;
+		if (request_live(rp, cp))
 		{
-			auto it = g_conns.find(fd);
-			if (it == g_conns.end())
-				continue;
-			Connection& c = it->second;
-			cleanup_connection_requests(c);
-			epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-			::close(fd);
-			log_debug("Closed fd=%d (housekeeping)", fd);
-			g_conns.erase(it);
+			ConnectionSink sink(*cp, *rp);
+			ResponseWriter out(*rp, sink);
+			if (g_user_request_ready)
+				g_user_request_ready(*rp, out);
+			out.finish();
 		}
+		// the final records are queued before the flags drop; the marker after them
+		// lets the IO thread release the request once nothing refers to it anymore
+		int fd = cp->fd;
+		rp->worker_active.store(false, std::memory_order_release);
+		cp->active_workers.fetch_sub(1, std::memory_order_release);
+		if (R->pending_output.push(new PendingChunk{ cp, fd, nullptr, {}, false }))
+			wake_reactor(*R);
 	}
 
-	static void finalize_request(Request& req);
-	thread_local Connection* tls_current_connection = nullptr;
+	// The pool found the request dead before its next stage started: skip the
+	// work, but hand the request back like a finished one so it is released.
+	static void drop_request(void* owner)
+	{
+		Request* rp = static_cast<Request*>(owner);
+		log_debug("Request %u expired before it ran", (unsigned)rp->id);
+		rp->cancel.cancel(); // past its deadline, the timer only fires on the next tick
+		handle_request(rp, static_cast<Connection*>(rp->conn_ptr));
+	}
 
 	static void internal_on_request_ready(Request& r)
 	{
@@ -245,20 +626,18 @@ namespace fcgi_conn
 			DynamicVariable* path_info_var = r.env.find("PATH_INFO");
 			
 			if (request_uri_var && request_uri_var->type == DynamicVariable::STRING) {
-				std::string& request_uri = request_uri_var->data.s;
-				if (request_uri.substr(0, global_config.fcgi_path_prefix.length()) == global_config.fcgi_path_prefix) {
-					std::string stripped_uri = request_uri.substr(global_config.fcgi_path_prefix.length());
-					if (stripped_uri.empty()) stripped_uri = "/";
-					request_uri_var->data.s = stripped_uri;
+				DynamicVariable::String& request_uri = request_uri_var->data.s;
+				if (request_uri.compare(0, global_config.fcgi_path_prefix.length(), global_config.fcgi_path_prefix) == 0) {
+					request_uri.erase(0, global_config.fcgi_path_prefix.length());
+					if (request_uri.empty()) request_uri.push_back('/');
 				}
 			}
 			
 			if (path_info_var && path_info_var->type == DynamicVariable::STRING) {
-				std::string& path_info = path_info_var->data.s;
-				if (path_info.substr(0, global_config.fcgi_path_prefix.length()) == global_config.fcgi_path_prefix) {
-					std::string stripped_path = path_info.substr(global_config.fcgi_path_prefix.length());
-					if (stripped_path.empty()) stripped_path = "/";
-					path_info_var->data.s = stripped_path;
+				DynamicVariable::String& path_info = path_info_var->data.s;
+				if (path_info.compare(0, global_config.fcgi_path_prefix.length(), global_config.fcgi_path_prefix) == 0) {
+					path_info.erase(0, global_config.fcgi_path_prefix.length());
+					if (path_info.empty()) path_info.push_back('/');
 				}
 			}
 		}
@@ -266,40 +645,31 @@ namespace fcgi_conn
 		c->active_workers.fetch_add(1, std::memory_order_relaxed);
 		r.worker_active.store(true, std::memory_order_release);
 
-		Request* rp_capture = &r;
-		Connection* c_capture = c;
-		::global_worker_pool.enqueue([rp_capture, c_capture]
-									 {
-			Request* rp = rp_capture;
-			Connection* cp = c_capture;
-			if (!rp || !cp) return;
-			if (!(rp->flags & Request::RESPONDED) && !cp->closed.load(std::memory_order_relaxed))
-			{
-				parse_endpoint_file(*rp, rp->env.find(global_config.endpoint_file_path));
-				parse_cookie_header(*rp, rp->env.find(global_config.http_cookies_var));
-				parse_query_string(*rp, rp->env.find(global_config.http_query_var));
-				parse_form_data(*rp);
-				if (global_config.session_auto_load)
-				{
-					DynamicVariable* sid = rp->cookies.find(global_config.session_cookie_name);
-					if (sid && sid->type == DynamicVariable::STRING)
-					{
-						session_start(*rp);
-					}
-				}
-				rp->headers["Content-Type"] = global_config.default_content_type;
-
-				std::lock_guard<std::mutex> lk(g_pending_output_mutex);
-				g_pending_output.push_back(rp);
-				if (g_eventfd != -1)
-				{
-					uint64_t val = 1;
-					ssize_t wr = write(g_eventfd, &val, sizeof(val));
-					(void)wr; // best-effort wakeup
-				}
-			}
-			rp->worker_active.store(false, std::memory_order_release);
-			cp->active_workers.fetch_sub(1, std::memory_order_relaxed); });
+		Request* rp = &r;
+		r.work.task_class = TASK_REQUEST;
+		r.work.tenant = request_tenant(r);
+		r.work.token = &r.cancel;
+		r.work.on_drop = drop_request;
+		r.work.owner = &r;
+		if (prepare_may_block(r) && ::global_blocking_pool.size())
+		{
+			r.work.fn = [rp, c]
+			{
+				prepare_request(rp, c);
+				rp->work.fn = [rp, c]
+				{ handle_request(rp, c); };
+				if (!::global_worker_pool.enqueue(rp->work))
+					handle_request(rp, c); // shutting down
+			};
+			::global_blocking_pool.enqueue(r.work);
+			return;
+		}
+		r.work.fn = [rp, c]
+		{
+			prepare_request(rp, c);
+			handle_request(rp, c);
+		};
+		::global_worker_pool.enqueue(r.work);
 	}
 
 	static void log_errno(const char* msg)
@@ -307,108 +677,107 @@ namespace fcgi_conn
 		log_error("%s: %s", msg, std::strerror(errno));
 	}
 
-	static void process_pending_output()
+	static void process_pending_output(Reactor& R)
 	{
-		std::vector<Request*> pending;
-		{
-			std::lock_guard<std::mutex> lk(g_pending_output_mutex);
-			pending.swap(g_pending_output);
-		}
-
-		for (Request* r : pending)
+		PendingChunk* pending = R.pending_output.take_all();
+		for (PendingChunk* p = pending; p; p = p->next)
 		{
-			if (!r || (r->flags & Request::RESPONDED))
-				continue;
-
-			Connection* c = static_cast<Connection*>(r->conn_ptr);
-			if (!c || c->closed.load(std::memory_order_relaxed))
-				continue;
-
-			std::vector<uint8_t> local_out;
-			local_out.reserve(1024);
-
-			if (g_user_request_ready)
+			PendingChunk& pc = *p;
+			if (!pc.req)
+				continue; // done marker, the connection may already be gone
+			// a non-zero queued_bytes keeps both the connection and the request alive until here
+			Connection* c = pc.conn;
+			Request* r = pc.req;
+			c->queued_bytes.fetch_sub(pc.data.size(), std::memory_order_relaxed);
+			if (c->closed.load(std::memory_order_relaxed) || (r->flags & Request::RESPONDED))
 			{
-				tls_current_connection = c;
-				g_user_request_ready(*r, local_out);
-				tls_current_connection = nullptr;
+				publish_backlog(*c); // dropped: client gone, or request already failed/aborted
+				continue;
 			}
-
-			if (!local_out.empty())
+			if (pc.last)
+				r->flags |= Request::RESPONDED;
+			c->out.append(std::move(pc.data)); // linked, not copied
+			flush_connection(*c);
+			publish_backlog(*c);
+		}
+		// finished requests can be released now that their records are linked in
+		int prev_fd = -1;
+		while (PendingChunk* pc = pending)
+		{
+			pending = pc->next;
+			if (pc->fd != prev_fd)
 			{
-				bool was_empty = (c->out_pos == c->out_buf.size());
-				if (was_empty && c->out_buf.capacity() == 0)
-					c->out_buf.reserve(global_config.output_buffer_initial);
-				c->out_buf.insert(c->out_buf.end(), local_out.begin(), local_out.end());
-
-				if (was_empty && g_epfd != -1)
-					update_write_interest(*c, g_epfd, true);
+				prev_fd = pc->fd;
+				auto it = R.conns.find(pc->fd);
+				if (it != R.conns.end() && &it->second == pc->conn)
+					after_io(R, it->second);
 			}
+			delete pc;
 		}
 	}
 
-	static void maybe_update_epoll(Connection& c, int epfd, uint32_t desired)
+	static void maybe_update_epoll(Connection& c, uint32_t desired)
 	{
 		if (desired == c.epoll_mask)
 			return;
 		epoll_event ev{};
 		ev.data.fd = c.fd;
 		ev.events = desired;
-		epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+		epoll_ctl(c.reactor->epfd, EPOLL_CTL_MOD, c.fd, &ev);
 		c.epoll_mask = desired;
 	}
 
-	static void flush_connection(Connection& c, int epfd)
+	static void flush_connection(Connection& c)
 	{
-		while (true)
+#ifdef WASAPI_IO_URING
+		if (c.reactor->ring)
 		{
-			size_t remaining = c.out_pos < c.out_buf.size() ? (c.out_buf.size() - c.out_pos) : 0;
-			if (remaining == 0)
-			{
-				update_write_interest(c, epfd, false);
-				if (c.out_pos != 0)
-				{
-					c.out_buf.clear();
-					c.out_pos = 0;
-				}
-				if (should_close_connection(c))
-					g_close_queue.push_back(c.fd);
-				return;
-			}
-			ssize_t n = ::send(c.fd, c.out_buf.data() + c.out_pos, remaining, 0);
-			if (n > 0)
-			{
-				c.out_pos += (size_t)n;
-				continue;
-			}
-			if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
-			{
-				update_write_interest(c, epfd, true);
-				return;
-			}
-			if (n <= 0)
-			{
-				log_errno("send");
-				c.closed.store(true, std::memory_order_relaxed);
-				return;
-			}
+			uring_send(c);
+			return;
+		}
+#endif
+		ssize_t sent = c.out.flush(c.fd);
+		if (sent < 0)
+		{
+			log_errno("sendmsg");
+			c.out.clear();
+			c.closed.store(true, std::memory_order_relaxed);
+			publish_backlog(c);
+			return;
 		}
+		if (sent > 0)
+			publish_backlog(c);
+		if (!c.out.empty())
+		{
+			update_write_interest(c, true);
+			return;
+		}
+		update_write_interest(c, false);
+		if (should_close_connection(c))
+			c.reactor->close_queue.push_back(c.fd);
 	}
 
 	static Request* allocate_request(uint16_t id)
 	{
-		Arena* a = global_arena_manager.get();
+		Arena* a = global_arena_manager.get(current_numa_node(), ARENA_SMALL); // grown once CONTENT_LENGTH is in
 		if (!a)
 			return nullptr;
-		void* mem = a->alloc(sizeof(Request), alignof(Request));
-		if (!mem)
+		Request* r = Request::acquire(a, tls_io_connection ? tls_io_connection->reactor->now_ms : 0);
+		if (!r)
 		{
 			global_arena_manager.release(a);
 			return nullptr;
 		}
-		Request* r = new (mem) Request(a);
 		r->id = id;
 		r->conn_ptr = tls_io_connection;
+		if (tls_io_connection && global_config.max_request_time > 0)
+		{
+			Reactor& R = *tls_io_connection->reactor;
+			r->deadline.owner = r;
+			r->deadline.kind = TIMER_REQUEST;
+			r->work.deadline_ms = R.now_ms + (uint64_t)(global_config.max_request_time * 1000);
+			R.timers.schedule(r->deadline, r->work.deadline_ms);
+		}
 		return r;
 	}
 
@@ -417,12 +786,18 @@ namespace fcgi_conn
 		if (!r)
 			return;
 		Arena* a = r->arena;
-		r->~Request();
+		Connection* c = static_cast<Connection*>(r->conn_ptr);
+		if (c)
+			c->reactor->timers.cancel(r->deadline);
+		Request::retire(r);
 		if (a)
 			global_arena_manager.release(a);
-		if (g_accept_paused && global_arena_manager.available_count.load(std::memory_order_relaxed) > 0)
-			resume_accept();
-		process_waiting_connections();
+		if (!c)
+			return;
+		Reactor& R = *c->reactor;
+		if (R.accept_paused && global_arena_manager.available_count.load(std::memory_order_relaxed) > 0)
+			resume_accept(R);
+		process_waiting_connections(R);
 	}
 
 	static void finalize_request(Request& req)
@@ -436,11 +811,11 @@ namespace fcgi_conn
 				DynamicVariable* tp = f.find("temp_path");
 				if (!global_config.keep_uploaded_files && global_config.cleanup_temp_on_disconnect && tp && tp->type == DynamicVariable::STRING && !tp->data.s.empty())
 				{
-					::unlink(tp->data.s.c_str());
+					unlink_in_background(std::string(tp->data.s));
 					tp->data.s.clear();
 				}
 			}
-			req.files = DynamicVariable::make_array();
+			req.files.data.a.clear(); // in place, the array's storage is kept for the next request
 		}
 		req.body.clear();
 	}
@@ -449,68 +824,64 @@ namespace fcgi_conn
 	{
 		if (c.closed.load(std::memory_order_relaxed))
 		{
-			return c.active_workers.load(std::memory_order_relaxed) == 0 && (c.out_pos == c.out_buf.size());
+			return c.active_workers.load(std::memory_order_acquire) == 0 && c.queued_bytes.load(std::memory_order_acquire) == 0 && c.out.empty();
 		}
+		if (!c.had_request || c.waiting_for_arena || c.read_stalled || c.input_paused || !c.in_buf.empty())
+			return false; // input still pending (e.g. accepted while out of arenas or over budget)
+		if (c.active_workers.load(std::memory_order_acquire) != 0 || c.queued_bytes.load(std::memory_order_acquire) != 0)
+			return false; // response still being produced or waiting to be linked in
 
-		bool all_responded = true;
-		bool any_keep = false;
-		for (auto& kv : c.requests)
+		// with multiplexing the connection stays open until every request on it is answered,
+		// and beyond that unless one of them asked for the close (no FCGI_KEEP_CONN)
+		bool drop = c.close_when_done;
+		for (Request* rp : c.requests)
 		{
-			Request* rp = kv.second;
-			if (!rp || !(rp->flags & Request::RESPONDED))
-			{
-				all_responded = false;
-				break;
-			}
-			if (rp->flags & Request::KEEP_CONNECTION)
-			{
-				any_keep = true;
-				break; // no need to continue scanning
-			}
+			if (!(rp->flags & Request::RESPONDED))
+				return false;
+			if (!(rp->flags & Request::KEEP_CONNECTION))
+				drop = true;
 		}
-		return all_responded && !any_keep && (c.out_pos == c.out_buf.size()) && c.active_workers.load(std::memory_order_relaxed) == 0;
+		return drop && c.out.empty();
 	}
 
-	static void init(int listen_fd, RequestReadyCallback cb)
+	static void init(RequestReadyCallback cb, size_t reactor_count)
 	{
-		(void)listen_fd;
 		g_user_request_ready = cb;
-		g_listen_fd = listen_fd;
 		auto& G = global_config;
 		std::string addr = G.fcgi_socket_path.empty() ? (std::string("tcp:") + std::to_string(G.fcgi_port)) : G.fcgi_socket_path;
-		log_info("FastCGI server listening on %s", addr.c_str());
+		log_info("FastCGI server listening on %s (%zu reactors)", addr.c_str(), reactor_count);
 	}
 
-	static void pause_accept()
+	static void pause_accept(Reactor& R)
 	{
-		if (g_accept_paused)
+		if (R.accept_paused)
 			return;
-		if (modify_listen_interest(false))
-			log_debug("Paused accept() (no arenas) fd=%d", g_listen_fd);
-		g_accept_paused = true;
+		if (modify_listen_interest(R, false))
+			log_debug("Paused accept() (no arenas) fd=%d", R.listen_fd);
+		R.accept_paused = true;
 	}
 
-	static void resume_accept()
+	static void resume_accept(Reactor& R)
 	{
-		if (!g_accept_paused)
+		if (!R.accept_paused)
 			return;
-		if (modify_listen_interest(true))
-			log_debug("Resumed accept() fd=%d", g_listen_fd);
-		g_accept_paused = false;
+		if (modify_listen_interest(R, true))
+			log_debug("Resumed accept() fd=%d", R.listen_fd);
+		R.accept_paused = false;
 	}
 
-	static void handle_new_connections(int listen_fd, int epfd)
+	static void handle_new_connections(Reactor& R)
 	{
 		if (global_arena_manager.available_count.load(std::memory_order_relaxed) == 0)
 		{
-			pause_accept();
+			pause_accept(R);
 			return;
 		}
 		while (true)
 		{
 			sockaddr_storage ss;
 			socklen_t slen = sizeof(ss);
-			int cfd = ::accept(listen_fd, (sockaddr*)&ss, &slen);
+			int cfd = ::accept(R.listen_fd, (sockaddr*)&ss, &slen);
 			if (cfd == -1)
 			{
 				if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -525,22 +896,83 @@ namespace fcgi_conn
 			epoll_event cev{};
 			cev.data.fd = cfd;
 			cev.events = EPOLLIN | EPOLLET;
-			epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
-			Connection& c = g_conns[cfd];
+			epoll_ctl(R.epfd, EPOLL_CTL_ADD, cfd, &cev);
+			Connection& c = R.conns[cfd];
 			c.fd = cfd;
+			c.reactor = &R;
+			start_idle_timer(R, c);
 			log_debug("Accepted fd=%d", cfd);
 			if (global_arena_manager.available_count.load(std::memory_order_relaxed) == 0)
 			{
-				pause_accept();
+				pause_accept(R);
 				break;
 			}
 		}
 	}
 
-	static void handle_io(int fd, uint32_t events, int epfd)
+	// Drain the socket into the input ring, parsing whenever the ring fills up so
+	// records are consumed in place. If the parser cannot free any space (a
+	// BEGIN_REQUEST waiting for an arena) reading stops with read_stalled set and
+	// process_waiting_connections resumes it; with EPOLLET no new edge would come.
+	static void read_input(Connection& c)
 	{
-		auto it = g_conns.find(fd);
-		if (it == g_conns.end())
+#ifdef WASAPI_IO_URING
+		if (c.reactor->ring)
+		{
+			uring_resume_input(c);
+			return;
+		}
+#endif
+		if (!c.in_buf.allocate(std::max(global_config.input_buffer_size, fcgi::MAX_RECORD_SIZE)))
+		{
+			log_error("input buffer allocation failed fd=%d", c.fd);
+			c.closed.store(true, std::memory_order_relaxed);
+			return;
+		}
+		c.read_stalled = false;
+		while (!c.closed.load(std::memory_order_relaxed))
+		{
+			if (input_over_budget(c))
+			{
+				pause_input(c);
+				break;
+			}
+			if (c.in_buf.full())
+			{
+				size_t before = c.in_buf.size();
+				process_fcgi(c);
+				if (c.in_buf.size() == before)
+				{
+					c.read_stalled = true;
+					return;
+				}
+				continue;
+			}
+			ssize_t r = c.in_buf.recv_from(c.fd);
+			if (r > 0)
+				continue;
+			if (r == 0)
+			{
+				c.closed.store(true, std::memory_order_relaxed);
+				break;
+			}
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			log_errno("recv");
+			c.closed.store(true, std::memory_order_relaxed);
+			break;
+		}
+		process_fcgi(c);
+		if (input_over_budget(c))
+			pause_input(c);
+	}
+
+	static void handle_io(Reactor& R, int fd, uint32_t events)
+	{
+		auto it = R.conns.find(fd);
+		if (it == R.conns.end())
 			return;
 
 		Connection& c = it->second;
@@ -551,74 +983,393 @@ namespace fcgi_conn
 
 		if (events & EPOLLIN)
 		{
-			while (true)
-			{
-				uint8_t buf[4096];
-				ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
-				if (r > 0)
-					c.in_buf.insert(c.in_buf.end(), buf, buf + r);
-				else if (r == 0)
-				{
-					c.closed.store(true, std::memory_order_relaxed);
-					break;
-				}
-				else
-				{
-					if (errno == EAGAIN || errno == EWOULDBLOCK)
-						break;
-					log_errno("recv");
-					c.closed.store(true, std::memory_order_relaxed);
-					break;
-				}
-			}
 			bool prev_wait = c.waiting_for_arena;
-			process_fcgi(c);
+			read_input(c);
 			if (!prev_wait && c.waiting_for_arena)
-				g_waiting_conns.push_back(fd);
-			flush_connection(c, epfd);
+				R.waiting_conns.push_back(fd);
+			flush_connection(c);
 		}
 
 		if (events & EPOLLOUT)
 		{
-			flush_connection(c, epfd);
+			flush_connection(c);
+		}
+
+		after_io(R, c);
+	}
+
+	// Common tail of an IO event: release finished requests, then run deferred closes.
+	// May close c itself, so it must be the last thing touching the connection.
+	static void after_io(Reactor& R, Connection& c)
+	{
+		int fd = c.fd;
+		c.last_active_ms = R.now_ms;
+		if (c.closed.load(std::memory_order_relaxed))
+		{
+			for (Request* rp : c.requests)
+				rp->cancel.cancel(); // nobody reads the output anymore
+		}
+		size_t live = c.requests.size();
+		release_finished_requests(c);
+		if (c.requests.empty() && c.in_buf.empty())
+			c.in_buf.decommit(INPUT_KEEP_BYTES); // an idle keep-alive connection holds no more than this
+		if (c.requests.size() < live && !c.in_buf.empty() && !c.waiting_for_arena)
+		{
+			// parsing may have stopped at a BEGIN reusing the ID of a request released just now
+			if (c.read_stalled)
+				read_input(c);
+			else
+				process_fcgi(c);
+			if (c.waiting_for_arena)
+				R.waiting_conns.push_back(fd);
+			flush_connection(c);
+		}
+
+		if (should_close_connection(c))
+			R.close_queue.push_back(fd);
+		process_close_queue(R);
+	}
+
+	// Release requests whose response is complete and whose worker has finished.
+	static void release_finished_requests(Connection& c)
+	{
+		if (c.queued_bytes.load(std::memory_order_acquire) != 0)
+			return; // queued records still point at their requests
+		c.requests.erase_if([&](Request* rp)
+		{
+			if (rp->worker_active.load(std::memory_order_acquire))
+				return false;
+			if (!(rp->flags & Request::KEEP_CONNECTION))
+				c.close_when_done = true;
+			if (rp->flags & Request::RESPONDED)
+			{
+				finalize_request(*rp);
+				release_request(rp);
+				return true;
+			}
+			if (rp->flags & (Request::FAILED | Request::ABORTED))
+			{
+				release_request(rp);
+				return true;
+			}
+			return false;
+		});
+		size_t before = c.input_bytes;
+		account_input(c);
+		if (c.input_bytes < before)
+			resume_paused_input(*c.reactor);
+	}
+
+	static void process_close_queue(Reactor& R)
+	{
+		if (!R.close_queue.empty())
+		{
+			std::vector<int> local;
+			local.swap(R.close_queue);
+			for (int cfd : local)
+			{
+				auto cit = R.conns.find(cfd);
+				if (cit != R.conns.end() && should_close_connection(cit->second))
+					close_connection(R, cfd);
+			}
 		}
+	}
+
+#ifdef WASAPI_IO_URING
+	static void uring_arm_recv(Connection& c)
+	{
+		if (c.recv_armed || c.closing || c.read_stalled || c.input_paused || c.closed.load(std::memory_order_relaxed))
+			return;
+		c.reactor->ring->prep_recv_multishot(c.fd, URING_RECV_GROUP, uring_ud(URING_RECV, c.fd));
+		c.recv_armed = true;
+		++c.ops_inflight;
+	}
 
-		for (auto it2 = c.requests.begin(); it2 != c.requests.end();)
+	// Queue the whole output chain as one linked sendmsg sequence. Segments stay
+	// in the chain (deque, so appends do not move them) until their completion.
+	static void uring_send(Connection& c)
+	{
+		if (c.sends_inflight || c.closing)
+			return;
+		if (c.out.empty())
 		{
-			Request* rp = it2->second;
-			if (rp && !rp->worker_active.load(std::memory_order_acquire))
+			if (should_close_connection(c))
+				c.reactor->close_queue.push_back(c.fd);
+			return;
+		}
+		unsigned n = uring_prep_send_chain(*c.reactor->ring, c.fd, c.out, c.send_iov, c.send_msgs, uring_ud(URING_SEND, c.fd));
+		c.sends_inflight += n;
+		c.ops_inflight += n;
+	}
+
+	// Copy received bytes into the input ring, parsing whenever it fills up. If the
+	// parser is blocked on an arena the rest is kept in overflow and the recv is
+	// cancelled; uring_resume_input picks it up again (same contract as read_input).
+	static void uring_deliver(Connection& c, const uint8_t* data, size_t len)
+	{
+		if (!c.in_buf.allocate(std::max(global_config.input_buffer_size, fcgi::MAX_RECORD_SIZE)))
+		{
+			log_error("input buffer allocation failed fd=%d", c.fd);
+			c.closed.store(true, std::memory_order_relaxed);
+			return;
+		}
+		while (len > 0 && !c.closed.load(std::memory_order_relaxed))
+		{
+			if (c.read_stalled || c.input_paused)
+			{
+				c.overflow.insert(c.overflow.end(), data, data + len);
+				return;
+			}
+			if (input_over_budget(c))
+			{
+				pause_input(c);
+				continue;
+			}
+			if (c.in_buf.full())
 			{
-				if (rp->flags & Request::RESPONDED)
+				size_t before = c.in_buf.size();
+				process_fcgi(c);
+				if (c.in_buf.size() == before)
 				{
-					finalize_request(*rp);
-					release_request(rp);
-					it2 = c.requests.erase(it2);
-					continue;
+					c.read_stalled = true;
+					if (c.recv_armed)
+						c.reactor->ring->prep_cancel(uring_ud(URING_RECV, c.fd), uring_ud(URING_CANCEL, c.fd));
 				}
-				if (rp->flags & (Request::FAILED | Request::ABORTED))
+				continue;
+			}
+			size_t n = c.in_buf.write(data, len);
+			data += n;
+			len -= n;
+		}
+		process_fcgi(c);
+		if (input_over_budget(c))
+			pause_input(c);
+	}
+
+	static void uring_resume_input(Connection& c)
+	{
+		c.read_stalled = false;
+		if (!c.overflow.empty())
+		{
+			std::vector<uint8_t> pending;
+			pending.swap(c.overflow);
+			uring_deliver(c, pending.data(), pending.size());
+		}
+		else
+			process_fcgi(c);
+		uring_arm_recv(c);
+	}
+
+	// Requests are released right away; the fd is closed and the connection erased
+	// only once the kernel has returned every operation that references it.
+	static void uring_close(Reactor& R, std::unordered_map<int, Connection>::iterator it)
+	{
+		Connection& c = it->second;
+		if (c.closing)
+			return;
+		c.closing = true;
+		c.closed.store(true, std::memory_order_relaxed);
+		cleanup_connection_requests(c);
+		R.timers.cancel(c.idle_timer);
+		if (c.ops_inflight == 0)
+		{
+			::close(c.fd);
+			log_debug("Closed fd=%d", c.fd);
+			R.conns.erase(it);
+			return;
+		}
+		R.ring->prep_cancel_fd(c.fd, uring_ud(URING_CANCEL, c.fd));
+		::shutdown(c.fd, SHUT_RDWR);
+	}
+
+	static void uring_on_accept(Reactor& R, int res, uint32_t flags)
+	{
+		if (res >= 0)
+		{
+			Connection& c = R.conns[res];
+			c.fd = res;
+			c.reactor = &R;
+			start_idle_timer(R, c);
+			log_debug("Accepted fd=%d", res);
+			uring_arm_recv(c);
+			if (global_arena_manager.available_count.load(std::memory_order_relaxed) == 0)
+				pause_accept(R);
+		}
+		else if (res != -ECANCELED)
+		{
+			errno = -res;
+			log_errno("accept"); // housekeeping re-arms
+		}
+		if (!(flags & IORING_CQE_F_MORE))
+		{
+			R.accept_armed = false;
+			if (res >= 0 && !R.accept_paused)
+				modify_listen_interest(R, true);
+		}
+	}
+
+	static void uring_on_recv(Reactor& R, Connection& c, int res, uint32_t flags)
+	{
+		if (flags & IORING_CQE_F_BUFFER)
+		{
+			uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+			if (res > 0 && !c.closing)
+			{
+				bool prev_wait = c.waiting_for_arena;
+				uring_deliver(c, R.recv_bufs->buffer(bid), (size_t)res);
+				if (!prev_wait && c.waiting_for_arena)
+					R.waiting_conns.push_back(c.fd);
+			}
+			R.recv_bufs->recycle(bid);
+		}
+		else if (res == 0)
+			c.closed.store(true, std::memory_order_relaxed);
+		else if (res < 0 && res != -ENOBUFS && res != -ECANCELED)
+		{
+			errno = -res;
+			log_errno("recv");
+			c.closed.store(true, std::memory_order_relaxed);
+		}
+		if (!(flags & IORING_CQE_F_MORE))
+		{
+			c.recv_armed = false;
+			--c.ops_inflight;
+			uring_arm_recv(c); // ENOBUFS or a kernel-side stop; no-op when closed or stalled
+		}
+		if (!c.closing)
+			uring_send(c);
+	}
+
+	static void uring_on_send(Connection& c, int res)
+	{
+		--c.sends_inflight;
+		--c.ops_inflight;
+		if (res > 0)
+			c.out.consume((size_t)res);
+		else if (res < 0 && res != -ECANCELED && !c.closing)
+		{
+			errno = -res;
+			log_errno("sendmsg");
+			c.closed.store(true, std::memory_order_relaxed);
+		}
+		if (c.sends_inflight > 0 || c.closing)
+		{
+			publish_backlog(c);
+			return;
+		}
+		if (c.closed.load(std::memory_order_relaxed) && res < 0)
+			c.out.clear(); // nothing more will get through
+		publish_backlog(c);
+		uring_send(c); // whatever was appended meanwhile, or the cut short tail
+	}
+
+	static void uring_dispatch(Reactor& R, uint64_t ud, int res, uint32_t flags)
+	{
+		UringOp op = (UringOp)uring_ud_op(ud);
+		int fd = uring_ud_fd(ud);
+		switch (op)
+		{
+		case URING_ACCEPT:
+			uring_on_accept(R, res, flags);
+			return;
+		case URING_EVENT:
+			process_pending_output(R);
+			R.ring->prep_read(R.eventfd, &R.eventfd_value, sizeof(R.eventfd_value), uring_ud(URING_EVENT, R.eventfd));
+			break;
+		case URING_TIMER:
+			housekeeping(R);
+			R.ring->prep_timeout(&R.tick, uring_ud(URING_TIMER, -1));
+			break;
+		case URING_RECV:
+		case URING_SEND:
+		{
+			auto it = R.conns.find(fd);
+			if (it == R.conns.end())
+				return;
+			Connection& c = it->second;
+			if (op == URING_RECV)
+				uring_on_recv(R, c, res, flags);
+			else
+				uring_on_send(c, res);
+			if (c.closing)
+			{
+				if (c.ops_inflight == 0)
 				{
-					release_request(rp);
-					it2 = c.requests.erase(it2);
-					continue;
+					::close(fd);
+					log_debug("Closed fd=%d", fd);
+					R.conns.erase(it);
 				}
+				return;
 			}
-			++it2;
+			after_io(R, c);
+			return;
+		}
+		default:
+			return; // cancellation results
 		}
+		process_close_queue(R);
+	}
 
-		if (should_close_connection(c))
-			g_close_queue.push_back(fd);
+	static bool uring_setup(Reactor& R)
+	{
+		R.ring = new Uring();
+		R.recv_bufs = new UringBufferGroup();
+		if (!R.ring->init(URING_ENTRIES, URING_ENTRIES * 4) || !R.recv_bufs->init(*R.ring, URING_RECV_GROUP, URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE))
+		{
+			log_errno("io_uring setup");
+			delete R.recv_bufs;
+			delete R.ring;
+			R.recv_bufs = nullptr;
+			R.ring = nullptr;
+			return false;
+		}
+		return true;
+	}
 
-		if (!g_close_queue.empty())
+	// Completion-driven variant of run(): multishot accept, multishot recv into a
+	// provided buffers and linked sendmsg chains, all submitted per loop turn.
+	static int run_uring(Reactor& R)
+	{
+		R.eventfd = eventfd(0, EFD_CLOEXEC);
+		if (R.eventfd != -1)
+			R.ring->prep_read(R.eventfd, &R.eventfd_value, sizeof(R.eventfd_value), uring_ud(URING_EVENT, R.eventfd));
+		R.tick.tv_sec = 0;
+		R.tick.tv_nsec = TIMER_TICK_MS * 1000 * 1000;
+		R.ring->prep_timeout(&R.tick, uring_ud(URING_TIMER, -1));
+		modify_listen_interest(R, true);
+		int rc = 0;
+		while (true)
 		{
-			std::vector<int> local;
-			local.swap(g_close_queue);
-			for (int cfd : local)
-				if (should_close_connection(g_conns[cfd]))
-					close_connection(cfd, epfd);
+			int ret = R.ring->submit(1);
+			if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY)
+			{
+				errno = -ret;
+				log_errno("io_uring_enter");
+				rc = 1;
+				break;
+			}
+			while (io_uring_cqe* cqe = R.ring->peek_cqe())
+			{
+				uint64_t ud = cqe->user_data;
+				int res = cqe->res;
+				uint32_t flags = cqe->flags;
+				R.ring->cqe_seen();
+				uring_dispatch(R, ud, res, flags);
+			}
+		}
+		R.recv_bufs->destroy();
+		R.ring->destroy();
+		if (R.eventfd != -1)
+		{
+			::close(R.eventfd);
+			R.eventfd = -1;
 		}
+		return rc;
 	}
+#endif
 
-	static int create_listen_socket()
+	// reuse_port: bind with SO_REUSEPORT so each reactor gets its own accept queue (TCP only)
+	static int create_listen_socket(bool reuse_port)
 	{
 		int fd;
 		if (!global_config.fcgi_socket_path.empty())
@@ -657,6 +1408,8 @@ namespace fcgi_conn
 			}
 			int yes = 1;
 			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+			if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)
+				log_errno("setsockopt SO_REUSEPORT");
 			sockaddr_in addr{};
 			addr.sin_family = AF_INET;
 			addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -683,63 +1436,70 @@ namespace fcgi_conn
 		return fd;
 	}
 
-	static int run(int listen_fd)
+	static int run(Reactor& R)
 	{
+		R.now_ms = monotonic_ms();
+		if (global_config.io_backend == "uring")
+		{
+#ifdef WASAPI_IO_URING
+			if (uring_setup(R))
+				return run_uring(R);
+			log_error("io_uring unavailable, reactor %zu falls back to epoll", R.index);
+#else
+			log_error("built without io_uring support, using epoll");
+#endif
+		}
 		int epfd = epoll_create1(0);
 		if (epfd == -1)
 		{
 			log_errno("epoll_create1");
 			return 1;
 		}
-		g_epfd = epfd; // publish for worker wakeups
+		R.epfd = epfd; // publish for worker wakeups
 
-		g_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-		if (g_eventfd != -1)
+		R.eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (R.eventfd != -1)
 		{
 			epoll_event efd_ev{};
-			efd_ev.data.fd = g_eventfd;
+			efd_ev.data.fd = R.eventfd;
 			efd_ev.events = EPOLLIN | EPOLLET;
-			if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_eventfd, &efd_ev) == -1)
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, R.eventfd, &efd_ev) == -1)
 			{
 				log_errno("epoll_ctl eventfd");
-				::close(g_eventfd);
-				g_eventfd = -1;
+				::close(R.eventfd);
+				R.eventfd = -1;
 			}
 		}
 
-		epoll_event ev{};
-		ev.data.fd = listen_fd;
-		ev.events = EPOLLIN | EPOLLET;
-		if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) == -1)
+		if (!modify_listen_interest(R, true))
 		{
-			log_errno("epoll_ctl listen");
 			::close(epfd);
-			g_epfd = -1;
+			R.epfd = -1;
 			return 1;
 		}
-		g_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
-		if (g_timerfd != -1)
+		R.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (R.timerfd != -1)
 		{
 			itimerspec its{};
 			its.it_interval.tv_sec = 0;
-			its.it_interval.tv_nsec = 100 * 1000 * 1000;
-			its.it_value = its.it_interval; // first fire after 100ms
-			if (timerfd_settime(g_timerfd, 0, &its, nullptr) == -1)
+			its.it_interval.tv_nsec = TIMER_TICK_MS * 1000 * 1000;
+			its.it_value = its.it_interval; // first fire after one tick
+			if (timerfd_settime(R.timerfd, 0, &its, nullptr) == -1)
 			{
 				log_errno("timerfd_settime");
-				::close(g_timerfd);
-				g_timerfd = -1;
+				::close(R.timerfd);
+				R.timerfd = -1;
 			}
 			else
 			{
 				epoll_event tev{};
-				tev.data.fd = g_timerfd;
+				tev.data.fd = R.timerfd;
 				tev.events = EPOLLIN | EPOLLET;
-				if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_timerfd, &tev) == -1)
+				if (epoll_ctl(epfd, EPOLL_CTL_ADD, R.timerfd, &tev) == -1)
 				{
 					log_errno("epoll_ctl timerfd");
-					::close(g_timerfd);
-					g_timerfd = -1;
+					::close(R.timerfd);
+					R.timerfd = -1;
 				}
 			}
 		}
@@ -759,61 +1519,119 @@ namespace fcgi_conn
 			{
 				int fd = events[i].data.fd;
 				uint32_t evs = events[i].events;
-				if (fd == listen_fd)
-					handle_new_connections(listen_fd, epfd);
-				else if (fd == g_eventfd)
+				if (fd == R.listen_fd)
+					handle_new_connections(R);
+				else if (fd == R.eventfd)
 				{
 					uint64_t val;
-					ssize_t ret = ::read(g_eventfd, &val, sizeof(val)); // drain eventfd
+					ssize_t ret = ::read(R.eventfd, &val, sizeof(val)); // drain eventfd
 					(void)ret; // suppress unused variable warning
-					process_pending_output();
+					process_pending_output(R);
 				}
-				else if (fd == g_timerfd)
+				else if (fd == R.timerfd)
 				{
 					uint64_t expirations;
-					ssize_t ret = ::read(g_timerfd, &expirations, sizeof(expirations));
+					ssize_t ret = ::read(R.timerfd, &expirations, sizeof(expirations));
 					(void)ret; // suppress unused variable warning
-					housekeeping_close_idle(epfd);
+					housekeeping(R);
 				}
 				else
-					handle_io(fd, evs, epfd);
+					handle_io(R, fd, evs);
 			}
 		}
 		::close(epfd);
-		g_epfd = -1;
-		if (g_eventfd != -1)
+		R.epfd = -1;
+		if (R.eventfd != -1)
 		{
-			::close(g_eventfd);
-			g_eventfd = -1;
+			::close(R.eventfd);
+			R.eventfd = -1;
 		}
-		if (g_timerfd != -1)
+		if (R.timerfd != -1)
 		{
-			::close(g_timerfd);
-			g_timerfd = -1;
+			::close(R.timerfd);
+			R.timerfd = -1;
 		}
 		return 0;
 	}
 
+	static size_t reactor_count()
+	{
+		size_t n = global_config.fcgi_reactors;
+		if (n == 0)
+			n = std::thread::hardware_concurrency();
+		return n ? n : 1;
+	}
+
 	int serve(int port, const std::string& unix_socket, RequestReadyCallback cb)
 	{
 		uint16_t saved_port = global_config.fcgi_port;
 		std::string saved_path = global_config.fcgi_socket_path;
 		global_config.fcgi_port = (uint16_t)port;
 		global_config.fcgi_socket_path = unix_socket;
-		int listen_fd = create_listen_socket();
+		size_t count = reactor_count();
+		// TCP: one SO_REUSEPORT socket per reactor, the kernel spreads connections.
+		// UNIX: SO_REUSEPORT does not apply, so reactors share one socket and
+		// register it with EPOLLEXCLUSIVE so a new connection wakes a single reactor.
+		bool shared = !unix_socket.empty() || count == 1;
+		std::vector<Reactor*> reactors;
+		for (size_t i = 0; i < count; ++i)
+		{
+			Reactor* R = new Reactor();
+			R->index = i;
+			R->shared_listen = shared && count > 1;
+			R->listen_fd = (shared && i > 0) ? reactors[0]->listen_fd : create_listen_socket(!shared);
+			if (R->listen_fd == -1)
+			{
+				delete R;
+				break;
+			}
+			reactors.push_back(R);
+		}
 		global_config.fcgi_port = saved_port;
 		global_config.fcgi_socket_path = saved_path;
-		if (listen_fd == -1)
+		if (reactors.size() != count)
+		{
+			for (Reactor* R : reactors)
+				if (!shared || R->index == 0)
+					::close(R->listen_fd);
+			for (Reactor* R : reactors)
+				delete R;
 			return 1;
-		init(listen_fd, cb);
-		int rc = run(listen_fd);
-		for (auto& kv : g_conns)
+		}
+		init(cb, count);
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < count; ++i)
+		{
+			Reactor* R = reactors[i];
+			threads.emplace_back([R]
+								 {
+				register_thread_name(std::string("fcgi-") + std::to_string(R->index));
+				pin_thread(global_config.reactor_cpus, R->index);
+				run(*R); });
+		}
+		pin_thread(global_config.reactor_cpus, 0);
+		int rc = run(*reactors[0]);
+		for (auto& th : threads)
+			th.join();
+		for (Reactor* R : reactors)
+		{
+			for (auto& kv : R->conns)
+			{
+				cleanup_connection_requests(kv.second);
+				::close(kv.first);
+			}
+			R->conns.clear();
+			if (!shared || R->index == 0)
+				::close(R->listen_fd);
+		}
+		for (Reactor* R : reactors)
 		{
-			cleanup_connection_requests(kv.second);
-			::close(kv.first);
+#ifdef WASAPI_IO_URING
+			delete R->recv_bufs;
+			delete R->ring;
+#endif
+			delete R;
 		}
-		g_conns.clear();
-		::close(listen_fd);
 		if (!unix_socket.empty())
 			::unlink(unix_socket.c_str());
 		return rc;
@@ -7,12 +7,14 @@
 #include <unordered_map>
 #include <functional>
 #include "request.h"
+#include "response.h"
 
 struct epoll_event;
 
 namespace fcgi_conn
 {
-	using RequestReadyCallback = void (*)(Request&, std::vector<uint8_t>& out_buf);
+	// Runs on a worker thread; output streams to the client as it is flushed.
+	using RequestReadyCallback = void (*)(Request&, ResponseWriter& out);
 
 	int serve(int port, const std::string& unix_socket, RequestReadyCallback cb);
 }
@@ -0,0 +1,218 @@
+#include "fileops.h"
+#include "logger.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+FileExecutor global_file_executor;
+
+static const size_t WRITE_CHUNK = 64 * 1024; // coalesce small records into one write
+
+static std::atomic<size_t> g_next_file_key{ 0 };
+
+FileExecutor::~FileExecutor()
+{
+	shutdown();
+}
+
+void FileExecutor::start(size_t thread_count)
+{
+	if (!lanes.empty() || thread_count == 0)
+		return;
+	for (size_t i = 0; i < thread_count; ++i)
+		lanes.emplace_back(new Lane);
+	for (size_t i = 0; i < thread_count; ++i)
+	{
+		Lane& lane = *lanes[i];
+		lane.thread = std::thread([this, &lane, i]
+								  {
+			register_thread_name(std::string("file-") + std::to_string(i));
+			run(lane); });
+	}
+}
+
+void FileExecutor::submit(size_t key, Job job)
+{
+	if (lanes.empty())
+	{
+		job();
+		return;
+	}
+	Lane& lane = *lanes[key % lanes.size()];
+	{
+		std::lock_guard<std::mutex> lock(lane.mtx);
+		if (!lane.stopping)
+		{
+			lane.q.push_back(std::move(job));
+			job = nullptr;
+		}
+	}
+	if (job)
+		job(); // shutting down
+	else
+		lane.cv.notify_one();
+}
+
+void FileExecutor::run(Lane& lane)
+{
+	std::unique_lock<std::mutex> lock(lane.mtx);
+	while (true)
+	{
+		lane.cv.wait(lock, [&]
+					 { return lane.stopping || !lane.q.empty(); });
+		if (lane.q.empty())
+			return; // stopping, and everything queued has run
+		Job job = std::move(lane.q.front());
+		lane.q.pop_front();
+		lock.unlock();
+		job();
+		lock.lock();
+	}
+}
+
+void FileExecutor::shutdown()
+{
+	for (auto& lane : lanes)
+	{
+		std::lock_guard<std::mutex> lock(lane->mtx);
+		lane->stopping = true;
+	}
+	for (auto& lane : lanes)
+	{
+		lane->cv.notify_all();
+		if (lane->thread.joinable())
+			lane->thread.join();
+	}
+	lanes.clear();
+}
+
+void unlink_in_background(const std::string& path)
+{
+	global_file_executor.submit(std::hash<std::string>()(path), [path]
+								{ ::unlink(path.c_str()); });
+}
+
+BackgroundFile::BackgroundFile(const std::string& dir, const char* prefix, bool anonymous, ContentHash::Kind hash)
+	: state(std::make_shared<State>()), key(g_next_file_key.fetch_add(1, std::memory_order_relaxed))
+{
+	if (hash != ContentHash::NONE)
+		state->hash.reset(new ContentHash(hash));
+	std::string pattern = dir;
+	if (!pattern.empty() && pattern.back() != '/')
+		pattern.push_back('/');
+	pattern += prefix;
+	pattern += "XXXXXX";
+	queue([pattern, anonymous](State& s) mutable
+		  {
+		s.fd = mkostemp(pattern.data(), O_CLOEXEC);
+		if (s.fd < 0)
+		{
+			log_error("Temp file %s: %s", pattern.c_str(), std::strerror(errno));
+			s.failed = true;
+			return;
+		}
+		if (anonymous)
+			::unlink(pattern.c_str()); // lives until closed
+		else
+			s.path = pattern; });
+}
+
+BackgroundFile::~BackgroundFile()
+{
+	if (remove)
+	{
+		state->unwritten.fetch_sub(pending.size(), std::memory_order_relaxed);
+		pending.clear();
+	}
+	flush();
+	bool rm = remove;
+	queue([rm](State& s)
+		  {
+		if (s.fd >= 0)
+		{
+			::close(s.fd);
+			s.fd = -1;
+		}
+		if (rm && !s.path.empty())
+			::unlink(s.path.c_str()); });
+}
+
+void BackgroundFile::write(const void* data, size_t len)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	state->unwritten.fetch_add(len, std::memory_order_relaxed);
+	pending.insert(pending.end(), p, p + len);
+	if (pending.size() >= WRITE_CHUNK)
+		flush();
+}
+
+void BackgroundFile::flush()
+{
+	if (pending.empty())
+		return;
+	std::vector<uint8_t> data;
+	data.swap(pending);
+	queue([data = std::move(data)](State& s)
+		  {
+		const uint8_t* p = data.data();
+		size_t len = data.size();
+		if (s.hash)
+			s.hash->update(p, len); // the chunk is still in cache for the write
+		for (size_t off = 0; s.fd >= 0 && !s.failed && off < len;)
+		{
+			ssize_t w = ::write(s.fd, p + off, len - off);
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w <= 0)
+			{
+				log_error("Write to temp file %s failed: %s", s.path.empty() ? "(anonymous)" : s.path.c_str(), std::strerror(errno));
+				s.failed = true; // the rest is dropped, written tells how far it got
+				break;
+			}
+			off += (size_t)w;
+			s.written += (size_t)w;
+		}
+		s.unwritten.fetch_sub(len, std::memory_order_relaxed); });
+}
+
+void BackgroundFile::close()
+{
+	flush();
+	queue([](State& s)
+		  {
+		if (s.fd >= 0)
+		{
+			::close(s.fd);
+			s.fd = -1;
+		} });
+}
+
+std::string BackgroundFile::digest()
+{
+	return state->hash ? state->hash->hex() : std::string();
+}
+
+void BackgroundFile::wait()
+{
+	flush();
+	std::unique_lock<std::mutex> lock(state->mtx);
+	state->cv.wait(lock, [this]
+				   { return state->done == state->queued; });
+}
+
+void BackgroundFile::queue(std::function<void(State&)> op)
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mtx);
+		++state->queued;
+	}
+	std::shared_ptr<State> s = state;
+	global_file_executor.submit(key, [s, op = std::move(op)]
+								{
+		op(*s);
+		std::lock_guard<std::mutex> lock(s->mtx);
+		++s->done;
+		s->cv.notify_all(); });
+}
@@ -0,0 +1,106 @@
+#ifndef FILEOPS_H
+#define FILEOPS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "content_hash.h"
+
+// Background threads for blocking file operations, so IO loops never wait on a
+// disk: they queue jobs and move on. Each key maps to one lane (thread), so jobs
+// submitted under the same key run one at a time in submission order.
+class FileExecutor
+{
+  public:
+	using Job = std::function<void()>;
+
+	FileExecutor() = default;
+	~FileExecutor();
+
+	void start(size_t thread_count);
+	// Runs inline when no threads are running.
+	void submit(size_t key, Job job);
+	// Run what is still queued, then join.
+	void shutdown();
+
+  private:
+	struct Lane
+	{
+		std::thread thread;
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::deque<Job> q;
+		bool stopping = false;
+	};
+
+	void run(Lane& lane);
+
+	std::vector<std::unique_ptr<Lane>> lanes;
+};
+
+extern FileExecutor global_file_executor;
+
+// Queue removal of a file.
+void unlink_in_background(const std::string& path);
+
+// A temp file filled from an IO thread. Creation, writes and the final close are
+// queued on one lane of the file executor; writes are coalesced into chunks and
+// the content can be hashed there, in the same pass over each chunk as its write. wait() blocks until the
+// queued work has run, so only worker threads may call it; the accessors below
+// are valid after that.
+class BackgroundFile
+{
+  public:
+	// Creates "<dir>/<prefix>XXXXXX"; anonymous files are unlinked right away.
+	BackgroundFile(const std::string& dir, const char* prefix, bool anonymous, ContentHash::Kind hash = ContentHash::NONE);
+	~BackgroundFile(); // queues the close, and the removal if discard() was called
+	BackgroundFile(const BackgroundFile&) = delete;
+	BackgroundFile& operator=(const BackgroundFile&) = delete;
+
+	void write(const void* data, size_t len);
+	void flush(); // queue what write() has buffered
+	void close(); // flush and close the descriptor; the file stays
+	void discard() { remove = true; }
+	void wait(); // flushes first, so the writer must be done
+
+	// Bytes accepted by write() that are not on disk yet.
+	size_t unwritten() const { return state->unwritten.load(std::memory_order_relaxed); }
+
+	int fd() const { return state->fd; }
+	const std::string& path() const { return state->path; }
+	size_t written() const { return state->written; }
+	std::string digest(); // hex digest of what was written, "" without a hash; ends the hash
+	bool failed() const { return state->failed; }
+
+  private:
+	struct State
+	{
+		std::string path;
+		int fd = -1;
+		size_t written = 0;
+		std::unique_ptr<ContentHash> hash;
+		bool failed = false;
+		std::atomic<size_t> unwritten{ 0 };
+		std::mutex mtx;
+		std::condition_variable cv;
+		size_t queued = 0; // jobs submitted
+		size_t done = 0; // jobs finished
+	};
+
+	void queue(std::function<void(State&)> op);
+
+	std::shared_ptr<State> state; // shared with the queued jobs
+	std::vector<uint8_t> pending; // coalesced writes not queued yet
+	size_t key;
+	bool remove = false;
+};
+
+#endif // FILEOPS_H
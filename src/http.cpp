@@ -2,6 +2,8 @@
 #include "request.h"
 #include "dynamic_variable.h"
 #include "config.h"
+#include "multipart.h"
+#include <algorithm>
 #include <cctype>
 #include <vector>
 #include <unistd.h>
@@ -148,7 +150,7 @@ std::string build_query(const std::unordered_map<std::string, std::string>& para
 	return out;
 }
 
-void parse_query_string(const std::string& input, std::unordered_map<std::string, std::string>& out)
+void parse_query_string(std::string_view input, std::unordered_map<std::string, std::string>& out)
 {
 	size_t start = 0;
 	while (start <= input.size())
@@ -161,15 +163,15 @@ void parse_query_string(const std::string& input, std::unordered_map<std::string
 		{
 			if (amp > start)
 			{
-				std::string key = url_decode(input.substr(start, amp - start));
+				std::string key = url_decode(std::string(input.substr(start, amp - start)));
 				if (!key.empty())
 					out[key] = ""; // present with empty value
 			}
 		}
 		else
 		{
-			std::string key = url_decode(input.substr(start, eq - start));
-			std::string val = url_decode(input.substr(eq + 1, amp - (eq + 1)));
+			std::string key = url_decode(std::string(input.substr(start, eq - start)));
+			std::string val = url_decode(std::string(input.substr(eq + 1, amp - (eq + 1))));
 			if (!key.empty())
 				out[key] = val;
 		}
@@ -180,145 +182,17 @@ void parse_query_string(const std::string& input, std::unordered_map<std::string
 	}
 }
 
-bool extract_files_from_formdata(const std::string& body, const std::string& boundary, const std::string& upload_dir, std::unordered_map<std::string, std::string>& form_fields, DynamicVariable& files)
+bool extract_files_from_formdata(std::string_view body, const std::string& boundary, const std::string& upload_dir, std::unordered_map<std::string, std::string>& form_fields, DynamicVariable& files)
 {
 	if (boundary.empty())
 		return false;
-	files = DynamicVariable::make_array();
-	std::string delim = "--" + boundary;
-	size_t pos = 0;
-	while (true)
-	{
-		size_t start = body.find(delim, pos);
-		if (start == std::string::npos)
-			break;
-		start += delim.size();
-		if (start + 2 <= body.size() && body.compare(start, 2, "--") == 0)
-			break;
-		if (start < body.size() && body[start] == '\r' && start + 1 < body.size() && body[start + 1] == '\n')
-			start += 2;
-		else
-			return false;
-		size_t header_end = body.find("\r\n\r\n", start);
-		if (header_end == std::string::npos)
-			return false;
-		std::string headers = body.substr(start, header_end - start);
-		size_t content_start = header_end + 4;
-		size_t part_end = body.find("\r\n" + delim, content_start);
-		if (part_end == std::string::npos)
-			return false;
-		size_t content_len = part_end - content_start;
-		if (content_len >= 2 && body[content_start + content_len - 2] == '\r' && body[content_start + content_len - 1] == '\n')
-			content_len -= 2;
-		std::string field_name, filename, ctype;
-		size_t hpos = 0;
-		while (hpos < headers.size())
-		{
-			size_t line_end = headers.find("\r\n", hpos);
-			if (line_end == std::string::npos)
-				line_end = headers.size();
-			std::string line = headers.substr(hpos, line_end - hpos);
-			hpos = line_end + 2;
-			if (line.size() == 0)
-				break;
-			auto colon = line.find(':');
-			if (colon == std::string::npos)
-				continue;
-			std::string name = line.substr(0, colon);
-			std::string value = line.substr(colon + 1);
-			trim_spaces(value);
-			for (auto& c : name)
-				c = std::tolower(c);
-			if (name == "content-disposition")
-			{
-				size_t p = 0;
-				while (p < value.size())
-				{
-					size_t sc = value.find(';', p);
-					if (sc == std::string::npos)
-						sc = value.size();
-					if (p == 0)
-					{ /* form-data token */
-					}
-					size_t semi_next = sc;
-					size_t eqp = value.find('=', p);
-					if (eqp != std::string::npos && eqp < semi_next)
-					{
-						std::string attr = value.substr(p, eqp - p);
-						trim_spaces(attr);
-						size_t valstart = eqp + 1;
-						while (valstart < semi_next && (value[valstart] == ' ' || value[valstart] == '\t'))
-							++valstart;
-						if (valstart < semi_next && value[valstart] == '"' && semi_next > valstart + 1 && value[semi_next - 1] == '"')
-						{
-							std::string aval = value.substr(valstart + 1, semi_next - valstart - 2);
-							if (attr == "name")
-								field_name = aval;
-							else if (attr == "filename")
-								filename = aval;
-						}
-					}
-					if (sc == value.size())
-						break;
-					else
-						p = sc + 1;
-				}
-			}
-			else if (name == "content-type")
-			{
-				ctype = value;
-			}
-		}
-		if (filename.empty())
-		{
-			form_fields[field_name] = std::string(body, content_start, content_len);
-		}
-		else
-		{
-			std::string pattern = upload_dir;
-			if (!pattern.empty() && pattern.back() != '/')
-				pattern.push_back('/');
-			pattern += "fcgi_upload_XXXXXX";
-			std::vector<char> tmpl(pattern.begin(), pattern.end());
-			tmpl.push_back('\0');
-			int fd = mkstemp(tmpl.data());
-			if (fd != -1)
-			{
-				size_t written = 0;
-				const char* data_ptr = body.data() + content_start;
-				uint64_t hv = 1469598103934665603ULL;
-				for (size_t i = 0; i < content_len; ++i)
-				{
-					hv ^= (unsigned char)data_ptr[i];
-					hv *= 1099511628211ULL;
-				}
-				while (written < content_len)
-				{
-					ssize_t w = ::write(fd, data_ptr + written, content_len - written);
-					if (w <= 0)
-						break;
-					written += (size_t)w;
-				}
-				::close(fd);
-				char hash_hex[17];
-				std::snprintf(hash_hex, sizeof(hash_hex), "%016llx", (unsigned long long)hv);
-				DynamicVariable file = DynamicVariable::make_object();
-				file["field_name"] = field_name;
-				file["filename"] = filename;
-				if (!ctype.empty())
-					file["content_type"] = ctype;
-				file["temp_path"] = std::string(tmpl.data());
-				file["size"] = (double)written;
-				file["expected_size"] = (double)content_len;
-				file["hash_fnv1a64"] = std::string(hash_hex);
-				if (written != content_len)
-					file["partial"] = true;
-				files.push(std::move(file));
-			}
-		}
-		pos = part_end + 2; // skip CRLF before next delimiter search
-	}
-	return true;
+	MultipartParser parser(boundary, upload_dir);
+	parser.feed(reinterpret_cast<const uint8_t*>(body.data()), body.size());
+	bool ok = parser.finish();
+	for (auto& kv : parser.fields)
+		form_fields[kv.first] = std::move(kv.second);
+	files = std::move(parser.files);
+	return ok;
 }
 
 void parse_cookie_header(Request& r, DynamicVariable* cookie_var)
@@ -374,22 +248,22 @@ void parse_query_string(Request& r, DynamicVariable* query_string)
 
 void parse_json_form_data(Request& r)
 {
-	DynamicVariable parsed;
+	DynamicVariable parsed(r.params.get_allocator()); // built in the arena, moved from there
 	size_t errpos = 0;
-	if (parse_json(r.body, parsed, &errpos))
+	if (parse_json(r.body.view(), parsed, &errpos))
 	{
 		if (parsed.type == DynamicVariable::OBJECT)
 		{
 			if (r.params.type != DynamicVariable::OBJECT)
 				r.params = DynamicVariable::make_object();
 			for (auto& kv : parsed.data.o)
-				r.params[kv.first] = kv.second;
+				r.params[kv.first] = std::move(kv.second);
 		}
 		else
 		{
 			if (r.params.type != DynamicVariable::OBJECT)
 				r.params = DynamicVariable::make_object();
-			r.params["_json"] = parsed;
+			r.params["_json"] = std::move(parsed);
 		}
 	}
 	else
@@ -402,24 +276,25 @@ void parse_json_form_data(Request& r)
 
 void parse_multipart_form_data(Request& r)
 {
-	const DynamicVariable* it_ct = r.env.find("CONTENT_TYPE");
-	if (!it_ct || it_ct->type != DynamicVariable::STRING)
-		return;
-	std::string ct = it_ct->data.s;
-	std::string lct = ct;
-	for (auto& c : lct)
-		c = std::tolower(c);
-	std::string boundary;
-	std::string key = "boundary=";
-	size_t bpos = lct.find(key);
-	if (bpos != std::string::npos)
-		boundary = ct.substr(bpos + key.size());
-	if (!boundary.empty() && boundary.front() == '"' && boundary.back() == '"' && boundary.size() >= 2)
-		boundary = boundary.substr(1, boundary.size() - 2);
-	if (boundary.empty())
-		return;
 	std::unordered_map<std::string, std::string> tmp;
-	extract_files_from_formdata(r.body, boundary, global_config.upload_tmp_dir, tmp, r.files);
+	if (r.multipart)
+	{
+		// already parsed while FCGI_STDIN arrived
+		r.multipart->finish();
+		tmp = std::move(r.multipart->fields);
+		r.files = std::move(r.multipart->files);
+		r.multipart.reset();
+	}
+	else
+	{
+		const DynamicVariable* it_ct = r.env.find("CONTENT_TYPE");
+		if (!it_ct || it_ct->type != DynamicVariable::STRING)
+			return;
+		std::string boundary = multipart_form_boundary(it_ct->data.s);
+		if (boundary.empty())
+			return;
+		extract_files_from_formdata(r.body.view(), boundary, global_config.upload_tmp_dir, tmp, r.files);
+	}
 	r.params.type = DynamicVariable::OBJECT;
 	for (auto& kv : tmp)
 		r.params[kv.first] = DynamicVariable::make_string(kv.second);
@@ -428,18 +303,40 @@ void parse_multipart_form_data(Request& r)
 void parse_urlencoded_form_data(Request& r)
 {
 	std::unordered_map<std::string, std::string> tmp;
-	parse_query_string(r.body, tmp);
+	parse_query_string(r.body.view(), tmp);
 	r.params.type = DynamicVariable::OBJECT;
 	for (auto& kv : tmp)
 		r.params[kv.first] = DynamicVariable::make_string(kv.second);
 }
 
+static bool contains_nocase(std::string_view s, std::string_view what)
+{
+	auto it = std::search(s.begin(), s.end(), what.begin(), what.end(), [](char a, char b)
+						  { return std::tolower((unsigned char)a) == b; });
+	return it != s.end();
+}
+
+bool body_parsed_in_memory(std::string_view content_type)
+{
+	return contains_nocase(content_type, "application/json") || contains_nocase(content_type, "application/x-www-form-urlencoded");
+}
+
+size_t request_body_limit(Request& r)
+{
+	const DynamicVariable* ct = r.env.find("CONTENT_TYPE");
+	if (ct && ct->type == DynamicVariable::STRING && body_parsed_in_memory(ct->data.s))
+		return global_config.max_parsed_body_bytes;
+	return global_config.max_stdin_bytes;
+}
+
 void parse_form_data(Request& r)
 {
 	const DynamicVariable* it_ct = r.env.find("CONTENT_TYPE");
 	if (!it_ct || it_ct->type != DynamicVariable::STRING)
 		return;
-	std::string ct = it_ct->data.s;
+	if (body_parsed_in_memory(it_ct->data.s) && r.body.size() > global_config.max_parsed_body_bytes)
+		return; // left unparsed; FastCGI refuses such bodies while they arrive, the ws port does not
+	std::string ct(it_ct->data.s);
 	std::string lct = ct;
 	for (auto& c : lct)
 		c = std::tolower(c);
@@ -457,13 +354,31 @@ void parse_form_data(Request& r)
 	}
 }
 
-void output_headers(Request& r, std::ostringstream& oss)
+bool form_data_touches_disk(Request& r)
+{
+	if (r.body.spilled() || r.multipart)
+		return true;
+	const DynamicVariable* ct = r.env.find("CONTENT_TYPE");
+	return ct && ct->type == DynamicVariable::STRING && !multipart_form_boundary(ct->data.s).empty();
+}
+
+uint32_t request_tenant(Request& r)
+{
+	if (global_config.tenant_var.empty())
+		return 0;
+	const DynamicVariable* v = r.env.find(global_config.tenant_var);
+	if (!v || v->type != DynamicVariable::STRING)
+		return 0;
+	return (uint32_t)std::hash<std::string_view>()(v->data.s);
+}
+
+void output_headers(Request& r, std::ostream& oss)
 {
 	for (auto& kv : r.headers.data.o)
 	{
 		if (kv.second.type == DynamicVariable::STRING)
 		{
-			std::string lname = kv.first;
+			std::string lname(kv.first);
 			for (auto& c : lname)
 				c = std::tolower(c);
 			oss << kv.first << ": " << kv.second.data.s << "\r\n";
@@ -478,8 +393,11 @@ void output_headers(Request& r, std::ostringstream& oss)
 
 void parse_endpoint_file(Request& r, DynamicVariable* file_path)
 {
-	r.context = DynamicVariable::make_object();
+	if (r.context.type == DynamicVariable::OBJECT)
+		r.context.data.o.clear(); // keeps the buckets of a recycled request
+	else
+		r.context = DynamicVariable::make_object();
 	if (!file_path || file_path->type != DynamicVariable::STRING)
 		return;
-	load_kv_file(file_path->data.s, r.context);
+	load_kv_file(std::string(file_path->data.s), r.context);
 }
\ No newline at end of file
@@ -2,17 +2,18 @@
 #define HTTP_H
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include "dynamic_variable.h"
 #include "request.h"
 
-void parse_query_string(const std::string& input, std::unordered_map<std::string, std::string>& out);
+void parse_query_string(std::string_view input, std::unordered_map<std::string, std::string>& out);
 std::string url_decode(const std::string& s);
 std::string url_encode(const std::string& s);
 std::string build_query(const std::unordered_map<std::string, std::string>& params);
 
-bool extract_files_from_formdata(const std::string& body, const std::string& boundary, const std::string& upload_dir, std::unordered_map<std::string, std::string>& form_fields, DynamicVariable& files_out);
+bool extract_files_from_formdata(std::string_view body, const std::string& boundary, const std::string& upload_dir, std::unordered_map<std::string, std::string>& form_fields, DynamicVariable& files_out);
 
 void parse_cookie_header(Request& r, DynamicVariable* cookie_var);
 void parse_query_string(Request& r, DynamicVariable* query_string);
@@ -20,7 +21,15 @@ void parse_json_form_data(Request& r);
 void parse_multipart_form_data(Request& r);
 void parse_urlencoded_form_data(Request& r);
 void parse_form_data(Request& r);
-void output_headers(Request& r, std::ostringstream& oss);
+// JSON and urlencoded bodies are parsed whole into request memory, so they are held
+// to max_parsed_body_bytes rather than max_stdin_bytes.
+bool body_parsed_in_memory(std::string_view content_type);
+size_t request_body_limit(Request& r);
+// Whether parse_form_data() may wait on the disk: a spilled body, or uploads.
+bool form_data_touches_disk(Request& r);
+// Fair-queueing key: hash of the tenant_var env value, 0 without one.
+uint32_t request_tenant(Request& r);
+void output_headers(Request& r, std::ostream& oss);
 void parse_endpoint_file(Request& r, DynamicVariable* file_path);
 
 std::string base64_encode(const uint8_t* data, size_t len);
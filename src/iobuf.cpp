@@ -0,0 +1,194 @@
+#include "iobuf.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+
+void OutputChain::append(std::vector<uint8_t>&& seg)
+{
+	if (seg.empty())
+		return;
+	bytes += seg.size();
+	segments.push_back(std::move(seg));
+}
+
+void OutputChain::consume(size_t n)
+{
+	bytes -= n;
+	while (n > 0)
+	{
+		size_t avail = segments.front().size() - head_pos;
+		if (n < avail)
+		{
+			head_pos += n;
+			return;
+		}
+		n -= avail;
+		segments.pop_front();
+		head_pos = 0;
+	}
+}
+
+void OutputChain::clear()
+{
+	segments.clear();
+	head_pos = 0;
+	bytes = 0;
+}
+
+ssize_t OutputChain::flush(int fd)
+{
+	size_t total = 0;
+	while (bytes > 0)
+	{
+		iovec iov[IOV_MAX];
+		size_t cnt = 0;
+		size_t skip = head_pos;
+		for (auto it = segments.begin(); it != segments.end() && cnt < IOV_MAX; ++it)
+		{
+			iov[cnt].iov_base = it->data() + skip;
+			iov[cnt].iov_len = it->size() - skip;
+			skip = 0;
+			++cnt;
+		}
+		msghdr msg{};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = cnt;
+		ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		if (n == 0)
+			break;
+		total += (size_t)n;
+		consume((size_t)n);
+	}
+	return (ssize_t)total;
+}
+
+InputRing::~InputRing()
+{
+	if (data)
+		munmap(data, capacity);
+}
+
+bool InputRing::allocate(size_t cap)
+{
+	if (data)
+		return true;
+	void* p = mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		return false;
+	data = (uint8_t*)p;
+	capacity = cap;
+	head = 0;
+	count = 0;
+	touched = 0;
+	return true;
+}
+
+void InputRing::decommit(size_t keep)
+{
+	if (count != 0)
+		return;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t from = (keep + page - 1) / page * page;
+	size_t to = std::min((touched + page - 1) / page * page, capacity);
+	if (to <= from)
+		return;
+	if (madvise(data + from, to - from, MADV_DONTNEED) == 0)
+		touched = from;
+}
+
+ssize_t InputRing::recv_from(int fd)
+{
+	size_t space = capacity - count;
+	if (space == 0)
+	{
+		errno = ENOBUFS;
+		return -1;
+	}
+	size_t tail = head + count;
+	if (tail >= capacity)
+		tail -= capacity;
+	iovec iov[2];
+	int cnt = 1;
+	iov[0].iov_base = data + tail;
+	if (tail + space <= capacity)
+		iov[0].iov_len = space;
+	else
+	{
+		iov[0].iov_len = capacity - tail;
+		iov[1].iov_base = data;
+		iov[1].iov_len = space - iov[0].iov_len;
+		cnt = 2;
+	}
+	msghdr msg{};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = cnt;
+	ssize_t n = ::recvmsg(fd, &msg, 0);
+	if (n > 0)
+	{
+		count += (size_t)n;
+		size_t end = (size_t)n > iov[0].iov_len ? capacity : tail + (size_t)n; // a wrap has been through the end already
+		if (end > touched)
+			touched = end;
+	}
+	return n;
+}
+
+size_t InputRing::write(const uint8_t* src, size_t len)
+{
+	size_t space = capacity - count;
+	if (len > space)
+		len = space;
+	size_t tail = head + count;
+	if (tail >= capacity)
+		tail -= capacity;
+	size_t first = capacity - tail < len ? capacity - tail : len;
+	std::memcpy(data + tail, src, first);
+	if (len > first)
+		std::memcpy(data, src + first, len - first);
+	count += len;
+	size_t end = len > first ? capacity : tail + len;
+	if (end > touched)
+		touched = end;
+	return len;
+}
+
+const uint8_t* InputRing::peek(size_t offset, size_t len, std::vector<uint8_t>& scratch) const
+{
+	size_t start = head + offset;
+	if (start >= capacity)
+		start -= capacity;
+	if (start + len <= capacity)
+		return data + start;
+	size_t first = capacity - start;
+	scratch.resize(len);
+	std::memcpy(scratch.data(), data + start, first);
+	std::memcpy(scratch.data() + first, data, len - first);
+	return scratch.data();
+}
+
+void InputRing::consume(size_t n)
+{
+	if (n >= count)
+	{
+		head = 0; // empty: restart at the front to maximise contiguous space
+		count = 0;
+		return;
+	}
+	head += n;
+	if (head >= capacity)
+		head -= capacity;
+	count -= n;
+}
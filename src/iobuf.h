@@ -0,0 +1,63 @@
+#ifndef IOBUF_H
+#define IOBUF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <sys/types.h>
+
+// Outbound byte stream kept as a chain of owned segments. Response buffers are
+// linked in (moved, never copied) and flushed with sendmsg() in IOV_MAX batches.
+struct OutputChain
+{
+	std::deque<std::vector<uint8_t>> segments;
+	size_t head_pos = 0; // bytes already sent from segments.front()
+	size_t bytes = 0; // unsent bytes across all segments
+
+	bool empty() const { return bytes == 0; }
+	size_t size() const { return bytes; }
+
+	void append(std::vector<uint8_t>&& seg); // link a finished buffer
+	void consume(size_t n); // drop n sent bytes from the front
+	void clear();
+
+	// Send until the chain is empty or the socket would block. Returns bytes sent,
+	// or -1 with errno set on a fatal socket error.
+	ssize_t flush(int fd);
+};
+
+// Fixed-capacity receive ring. recv() lands directly in free space and the
+// parser reads records in place; only a read that straddles the wrap point
+// is linearised into a caller-provided scratch buffer. The memory is mapped,
+// so pages are only committed once written, and decommit() returns them.
+struct InputRing
+{
+	uint8_t* data = nullptr;
+	size_t capacity = 0;
+	size_t head = 0; // offset of first readable byte
+	size_t count = 0; // readable bytes
+	size_t touched = 0; // bytes from the front written since the last decommit
+
+	InputRing() = default;
+	InputRing(const InputRing&) = delete;
+	InputRing& operator=(const InputRing&) = delete;
+	~InputRing();
+
+	bool allocate(size_t cap); // no-op if already allocated
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	bool full() const { return count == capacity; }
+
+	// Read once from fd into free space (up to two iovecs). Same return as recv().
+	ssize_t recv_from(int fd);
+	// Copy up to len bytes into free space, returns bytes taken.
+	size_t write(const uint8_t* src, size_t len);
+	// Pointer to len readable bytes starting at offset; copies into scratch only when wrapped.
+	const uint8_t* peek(size_t offset, size_t len, std::vector<uint8_t>& scratch) const;
+	void consume(size_t n);
+	// Empty ring only: gives the pages past the first keep bytes back to the OS.
+	void decommit(size_t keep);
+};
+
+#endif // IOBUF_H
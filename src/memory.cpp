@@ -1,81 +1,340 @@
 #include "memory.h"
+#include "affinity.h"
+#include "logger.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
 #include <cstdlib>
 #include <algorithm>
 #include <cstring>
 
+BlockPool global_block_pool; // before the manager, so it outlives the arenas
 ArenaManager global_arena_manager;
 
+static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+static size_t page_size()
+{
+	static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+static size_t round_up(size_t n, size_t to)
+{
+	return (n + to - 1) / to * to;
+}
+
+// Give the whole pages in [base + keep, base + dirty) back to the OS. The memory
+// stays mapped and reads as zero when touched again. MADV_DONTNEED rather than
+// MADV_FREE: pages freed lazily may still hold the old bytes, and the zeroing
+// in alloc() relies on everything past dirty being zero.
+static void decommit(uint8_t* base, size_t& dirty, size_t keep)
+{
+	uintptr_t from = round_up((uintptr_t)base + keep, page_size());
+	uintptr_t to = round_up((uintptr_t)base + dirty, page_size());
+	if (to <= from)
+		return;
+	if (madvise(reinterpret_cast<void*>(from), to - from, MADV_DONTNEED) != 0)
+		return; // still committed, still dirty
+	dirty = from - (uintptr_t)base;
+}
+
+static ArenaBlock* map_block(size_t capacity)
+{
+	void* p = mmap(nullptr, ArenaBlock::HEADER + capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+	ArenaBlock* b = new (p) ArenaBlock;
+	b->capacity = capacity;
+	return b;
+}
+
+static void unmap_block(ArenaBlock* b)
+{
+	munmap(b, ArenaBlock::HEADER + b->capacity);
+}
+
+BlockPool::~BlockPool()
+{
+	for (ArenaBlock* b : free_blocks)
+		unmap_block(b);
+	free_blocks.clear();
+}
+
+void BlockPool::configure(size_t size, size_t cached)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	block_size = size ? size : 64 * 1024;
+	max_cached = cached;
+}
+
+ArenaBlock* BlockPool::get(size_t min_capacity)
+{
+	if (min_capacity > block_size)
+		return map_block(min_capacity); // one-off, unmapped again by put()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!free_blocks.empty())
+		{
+			ArenaBlock* b = free_blocks.back();
+			free_blocks.pop_back();
+			return b;
+		}
+	}
+	return map_block(block_size);
+}
+
+void BlockPool::put(ArenaBlock* b)
+{
+	b->next = nullptr;
+	b->offset = 0;
+	if (b->capacity == block_size)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (free_blocks.size() < max_cached)
+		{
+			free_blocks.push_back(b);
+			return;
+		}
+	}
+	unmap_block(b);
+}
+
 Arena::~Arena()
 {
-	std::free(data);
+	reset();
+	if (data && owns_data)
+		munmap(data, capacity);
 }
 
+// A standalone arena maps its own pages.
 Arena::Arena(size_t cap)
 {
-	data = (uint8_t*)std::malloc(cap);
-	if (data)
+	void* p = cap ? mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) : MAP_FAILED;
+	if (p != MAP_FAILED)
 	{
+		data = (uint8_t*)p;
 		capacity = cap;
-		reset();
+		owns_data = true;
 	}
 }
 
-void Arena::reset()
+Arena::Arena(uint8_t* mem, size_t cap) : data(mem), capacity(cap)
 {
-	offset = 0;
 }
 
-void* Arena::alloc(size_t sz, size_t align)
+void Arena::reset(size_t keep)
 {
-	size_t base_addr = reinterpret_cast<size_t>(data);
+	offset = resident ? mark : 0;
+	while (ArenaBlock* b = chain)
+	{
+		chain = b->next;
+		global_block_pool.put(b);
+	}
+	if (keep < offset)
+		keep = offset;
+	if (dirty > keep)
+		decommit(data, dirty, keep);
+}
+
+static void* bump(uint8_t* base, size_t capacity, size_t& offset, size_t& dirty, size_t sz, size_t align)
+{
+	if (!base)
+		return nullptr;
+	size_t base_addr = reinterpret_cast<size_t>(base);
 	size_t cur = base_addr + offset;
 	size_t aligned = (cur + (align - 1)) & ~(align - 1);
-	size_t new_off = aligned - base_addr + sz;
+	size_t start = aligned - base_addr;
+	size_t new_off = start + sz;
 	if (new_off > capacity)
 		return nullptr;
 	offset = new_off;
 	void* ptr = reinterpret_cast<void*>(aligned);
 #ifdef ARENA_ZERO_CLEAR
-	memset(ptr, 0, sz);
+	if (start < dirty)
+		memset(ptr, 0, (new_off < dirty ? new_off : dirty) - start); // past dirty it is still zero
 #endif
+	if (new_off > dirty)
+		dirty = new_off;
 	return ptr;
 }
 
+// Only the newest block is tried; what is left in the older ones is given up.
+void* Arena::alloc(size_t sz, size_t align)
+{
+	void* p = chain ? bump(chain->data(), chain->capacity, chain->offset, chain->dirty, sz, align) : bump(data, capacity, offset, dirty, sz, align);
+	if (p || !reserve(sz + align))
+		return p;
+	return bump(chain->data(), chain->capacity, chain->offset, chain->dirty, sz, align);
+}
+
+bool Arena::reserve(size_t bytes)
+{
+	size_t left = chain ? chain->capacity - chain->offset : capacity - offset;
+	if (left >= bytes)
+		return true;
+	ArenaBlock* b = global_block_pool.get(bytes);
+	if (!b)
+		return false;
+	b->next = chain;
+	chain = b;
+	return true;
+}
+
+size_t Arena::used() const
+{
+	size_t n = offset;
+	for (const ArenaBlock* b = chain; b; b = b->next)
+		n += b->offset;
+	return n;
+}
+
+void* ArenaResource::do_allocate(size_t bytes, size_t align)
+{
+	void* p = arena ? arena->alloc(bytes, align) : nullptr;
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
 ArenaManager::~ArenaManager()
 {
 	for (auto* a : arenas)
 		delete a;
 	arenas.clear();
-	in_use.clear();
+	unmap_reservation();
+	free_stacks.reset();
+	node_count = 0;
 	available_count.store(0, std::memory_order_relaxed);
 }
 
-void ArenaManager::create_arenas(size_t count, size_t capacity)
+void ArenaManager::unmap_reservation()
 {
+	if (reservation)
+		munmap(reservation, reservation_size);
+	reservation = nullptr;
+	reservation_size = 0;
+}
+
+// Not thread-safe: called at startup, before any get or release.
+void ArenaManager::create_arenas(const size_t (&count)[ARENA_CLASSES], const size_t (&capacity)[ARENA_CLASSES], bool numa)
+{
+	int nodes = numa ? numa_node_count() : 1;
 	for (auto* a : arenas)
 		delete a;
 	arenas.clear();
-	in_use.clear();
-	for (size_t i = 0; i < count; ++i)
+	unmap_reservation();
+	node_count = (size_t)nodes;
+	free_stacks.reset(new FreeStack[ARENA_CLASSES * node_count]);
+	size_t align = hugepages ? HUGE_PAGE : page_size();
+	size_t total = 0;
+	for (size_t cls = 0; cls < ARENA_CLASSES; ++cls)
+	{
+		capacities[cls] = capacity[cls];
+		total += round_up(capacity[cls], page_size()) * count[cls];
+	}
+	uint8_t* base = nullptr;
+	if (total)
+	{
+		size_t size = total + align - page_size(); // room to align the base
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			log_error("Reserving %zu bytes for the arenas failed: %s", size, std::strerror(errno));
+		else
+		{
+			reservation = (uint8_t*)p;
+			reservation_size = size;
+			base = (uint8_t*)round_up((uintptr_t)p, align);
+			if (hugepages && madvise(base, total, MADV_HUGEPAGE) != 0)
+				log_error("Transparent huge pages for the arenas failed: %s", std::strerror(errno));
+		}
+	}
+	for (size_t cls = 0; cls < ARENA_CLASSES; ++cls)
 	{
-		Arena* a = new Arena(capacity);
-		a->management_flag = i;
-		arenas.push_back(a);
-		in_use.push_back(false);
+		size_t cap = round_up(capacity[cls], page_size());
+		for (size_t k = 0; k < count[cls]; ++k)
+		{
+			size_t i = arenas.size();
+			Arena* a = base ? new Arena(base, cap) : new Arena((size_t)0);
+			if (base)
+				base += cap;
+			a->management_flag = i;
+			a->size_class = (ArenaClass)cls;
+			if (nodes > 1 && a->data && bind_memory_to_node(a->data, a->capacity, (int)(k % nodes)))
+				a->node = (int)(k % nodes);
+			arenas.push_back(a);
+		}
 	}
-	available_count.store(count, std::memory_order_relaxed);
+	for (size_t i = arenas.size(); i-- > 0;)
+		push(stack_for(arenas[i]->size_class, arenas[i]->node), arenas[i]); // lowest index on top
+	available_count.store(arenas.size(), std::memory_order_relaxed);
 }
 
-Arena* ArenaManager::get()
+void ArenaManager::create_arenas(size_t count, size_t capacity, bool numa)
 {
-	std::lock_guard<std::mutex> lock(mutex);
-	for (size_t i = 0; i < arenas.size(); ++i)
+	size_t counts[ARENA_CLASSES] = {};
+	size_t capacities_in[ARENA_CLASSES] = { capacity, capacity, capacity };
+	counts[ARENA_LARGE] = count;
+	create_arenas(counts, capacities_in, numa);
+}
+
+ArenaClass ArenaManager::class_for(size_t bytes) const
+{
+	for (size_t cls = 0; cls + 1 < ARENA_CLASSES; ++cls)
+	{
+		if (bytes <= capacities[cls])
+			return (ArenaClass)cls;
+	}
+	return ARENA_LARGE;
+}
+
+Arena* ArenaManager::pop(FreeStack& s)
+{
+	uint64_t old = s.head.load(std::memory_order_acquire);
+	while ((uint32_t)old != 0)
 	{
-		if (!in_use[i])
+		Arena* a = arenas[(uint32_t)old - 1];
+		uint64_t next = ((old >> 32) + 1) << 32 | a->pool_next.load(std::memory_order_relaxed);
+		if (s.head.compare_exchange_weak(old, next, std::memory_order_acquire, std::memory_order_acquire))
+			return a;
+	}
+	return nullptr;
+}
+
+void ArenaManager::push(FreeStack& s, Arena* a)
+{
+	uint64_t self = a->management_flag + 1;
+	uint64_t old = s.head.load(std::memory_order_relaxed);
+	uint64_t next;
+	do
+	{
+		a->pool_next.store((uint32_t)old, std::memory_order_relaxed);
+		next = ((old >> 32) + 1) << 32 | self;
+	} while (!s.head.compare_exchange_weak(old, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+Arena* ArenaManager::get(int node, ArenaClass cls)
+{
+	if (node_count == 0)
+		return nullptr;
+	size_t first = node_index(node);
+	// up from cls first: a smaller arena still works, it just chains blocks sooner
+	static const ArenaClass order[ARENA_CLASSES][ARENA_CLASSES] = {
+		{ ARENA_SMALL, ARENA_MEDIUM, ARENA_LARGE },
+		{ ARENA_MEDIUM, ARENA_LARGE, ARENA_SMALL },
+		{ ARENA_LARGE, ARENA_MEDIUM, ARENA_SMALL },
+	};
+	for (ArenaClass c : order[cls < ARENA_CLASSES ? cls : ARENA_LARGE])
+	{
+		for (size_t k = 0; k < node_count; ++k)
 		{
-			in_use[i] = true;
-			available_count.fetch_sub(1, std::memory_order_relaxed);
-			return arenas[i];
+			// another node's arena, if nothing local is free
+			if (Arena* a = pop(free_stacks[c * node_count + (first + k) % node_count]))
+			{
+				a->in_use.store(true, std::memory_order_relaxed);
+				available_count.fetch_sub(1, std::memory_order_relaxed);
+				return a;
+			}
 		}
 	}
 	return nullptr;
@@ -83,14 +342,9 @@ Arena* ArenaManager::get()
 
 void ArenaManager::release(Arena* arena)
 {
-	if (!arena)
-		return;
-	std::lock_guard<std::mutex> lock(mutex);
-	auto i = arena->management_flag;
-	if (i < in_use.size() && in_use[i])
-	{
-		in_use[i] = false;
-		available_count.fetch_add(1, std::memory_order_relaxed);
-		arena->reset();
-	}
+	if (!arena || !arena->in_use.exchange(false, std::memory_order_relaxed))
+		return; // not ours, or released twice
+	arena->reset(watermark); // the pages above it go back to the OS
+	available_count.fetch_add(1, std::memory_order_relaxed); // before it can be popped, so the count never wraps
+	push(stack_for(arena->size_class, arena->node), arena);
 }
@@ -4,13 +4,56 @@
 #include <cstddef>
 #include <cstdint>
 #include <vector>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <new>
 #include <cstdlib>
 #include <type_traits>
 #include <atomic>
 
-#define ARENA_ZERO_CLEAR
+#define ARENA_ZERO_CLEAR // alloc() returns zeroed memory; only reused bytes need the memset
+
+// Request memory comes in three starting sizes; a request that outgrows its
+// arena chains extra blocks on, so the class only sets where it starts.
+enum ArenaClass : uint8_t
+{
+	ARENA_SMALL,
+	ARENA_MEDIUM,
+	ARENA_LARGE,
+	ARENA_CLASSES
+};
+
+// Extra memory chained onto a full arena. Blocks of the standard size come from
+// and go back to a shared pool; bigger ones are mapped for the one allocation.
+struct ArenaBlock
+{
+	static constexpr size_t HEADER = 64; // keeps data() aligned for anything
+
+	ArenaBlock* next = nullptr;
+	size_t capacity = 0; // usable bytes after the header
+	size_t offset = 0;
+	size_t dirty = 0; // bytes that were handed out before, the rest still reads zero
+
+	uint8_t* data() { return reinterpret_cast<uint8_t*>(this) + HEADER; }
+};
+
+struct BlockPool
+{
+	~BlockPool();
+	void configure(size_t block_size, size_t max_cached); // before first use
+	ArenaBlock* get(size_t min_capacity);
+	void put(ArenaBlock* b); // unmapped if oversized or the pool is full
+
+	size_t block_size = 64 * 1024; // usable bytes of a pooled block
+	size_t max_cached = 64; // free blocks kept mapped
+
+  private:
+	std::mutex mutex; // only taken when an arena overflows or is reset with a chain
+	std::vector<ArenaBlock*> free_blocks;
+};
+
+extern BlockPool global_block_pool;
 
 struct Arena
 {
@@ -18,27 +61,94 @@ struct Arena
 	size_t capacity = 0;
 	size_t offset = 0;
 	size_t management_flag = 0;
+	int node = -1; // NUMA node the pages are bound to, -1 for none
+	ArenaClass size_class = ARENA_LARGE;
+	ArenaBlock* chain = nullptr; // blocks chained on after data filled up, newest first
+	size_t dirty = 0; // bytes of data touched since they were last decommitted
+	bool owns_data = false; // data is our own mapping, not a slice of the manager's
+	void* resident = nullptr; // object kept at the start of data over releases (a recycled Request)
+	size_t mark = 0; // end of what resident keeps; reset() rewinds to here instead of 0
+	std::atomic<bool> in_use{ false }; // handed out by ArenaManager::get
+	std::atomic<uint32_t> pool_next{ 0 }; // free-list link, index + 1 (0 ends the list)
 
 	~Arena();
 	Arena(size_t cap);
+	Arena(uint8_t* mem, size_t cap); // over pages owned by someone else, untouched so far
 	Arena() = default; // fuck
 	Arena(const Arena&) = delete; // fuck
 	Arena& operator=(const Arena&) = delete; // fuck
-	void reset();
+	// Rewinds to mark (the start without a resident object), hands the chained
+	// blocks back, and returns the pages past the first keep bytes to the OS;
+	// they read as zero when touched again.
+	void reset(size_t keep = SIZE_MAX);
 	void* alloc(size_t sz, size_t align = alignof(std::max_align_t));
+	bool reserve(size_t bytes); // chain a block now if bytes would not fit, so they end up in one piece
+	size_t used() const; // bytes handed out, chained blocks included
+};
+
+// std::pmr face of an arena, for containers that should live and die with it.
+// Deallocation is a no-op: everything goes at once when the arena is reset. It
+// only notes when memory below the arena's mark is given up, which means a
+// container the resident object keeps was replaced or outgrew its storage.
+struct ArenaResource : std::pmr::memory_resource
+{
+	Arena* arena;
+	bool kept_released = false;
+
+	explicit ArenaResource(Arena* a) : arena(a) {}
+
+  private:
+	void* do_allocate(size_t bytes, size_t align) override;
+	void do_deallocate(void* p, size_t, size_t) override
+	{
+		if (arena && arena->mark && p >= arena->data && p < arena->data + arena->mark)
+			kept_released = true;
+	}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
 };
 
+// Free arenas sit on lock-free stacks, one per class and NUMA node, linked by
+// index. The head packs the top index with a tag bumped on every change, so a
+// pop racing a pop/push pair of the same arena fails its CAS instead of
+// corrupting the list. get and release never block on the arenas themselves,
+// which live as long as the manager; only chained blocks go through a lock.
 struct ArenaManager
 {
 	std::vector<Arena*> arenas;
-	std::mutex mutex;
-	std::vector<bool> in_use;
 	std::atomic<size_t> available_count{ 0 };
+	size_t watermark = SIZE_MAX; // bytes a released arena keeps committed
+	bool hugepages = false; // ask for transparent huge pages on the reservation
 
 	~ArenaManager();
-	void create_arenas(size_t count, size_t capacity);
-	Arena* get();
+	// All arenas are slices of one MAP_NORESERVE reservation: nothing is committed
+	// until a request touches it, and release() decommits past the watermark.
+	// numa: spread the arenas over the NUMA nodes, bound before first touch.
+	void create_arenas(const size_t (&count)[ARENA_CLASSES], const size_t (&capacity)[ARENA_CLASSES], bool numa = false);
+	void create_arenas(size_t count, size_t capacity, bool numa = false); // all ARENA_LARGE
+	// Prefers cls, then larger classes, then smaller ones; within each, node first.
+	Arena* get(int node = -1, ArenaClass cls = ARENA_LARGE);
 	void release(Arena* arena);
+	ArenaClass class_for(size_t bytes) const; // smallest class whose arenas hold bytes
+	size_t class_capacity(ArenaClass cls) const { return capacities[cls]; }
+
+  private:
+	struct alignas(64) FreeStack
+	{
+		std::atomic<uint64_t> head{ 0 }; // tag << 32 | (top index + 1)
+	};
+
+	Arena* pop(FreeStack& s);
+	void push(FreeStack& s, Arena* a);
+	size_t node_index(int node) const { return node >= 0 && (size_t)node < node_count ? (size_t)node : 0; }
+	FreeStack& stack_for(ArenaClass cls, int node) { return free_stacks[cls * node_count + node_index(node)]; }
+
+	void unmap_reservation();
+
+	std::unique_ptr<FreeStack[]> free_stacks; // ARENA_CLASSES * node_count
+	size_t node_count = 0;
+	uint8_t* reservation = nullptr;
+	size_t reservation_size = 0;
+	size_t capacities[ARENA_CLASSES] = {};
 };
 
 extern ArenaManager global_arena_manager;
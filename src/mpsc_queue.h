@@ -0,0 +1,51 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+
+// Intrusive lock-free multi-producer single-consumer queue. Producers link a node
+// with one CAS; the consumer detaches the whole list at once and gets it back in
+// push order, so there is no ABA to worry about. push() reports the empty to
+// non-empty transition: only that producer needs to wake the consumer, which must
+// clear its wakeup before calling take_all(). Detaching is a single exchange, so
+// several consumers may also share one queue. T needs a `T* next` member.
+template <typename T>
+class MpscQueue
+{
+  public:
+	MpscQueue() = default;
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	// Returns true if the queue was empty.
+	bool push(T* node)
+	{
+		T* head = top.load(std::memory_order_relaxed);
+		do
+			node->next = head;
+		while (!top.compare_exchange_weak(head, node, std::memory_order_acq_rel, std::memory_order_relaxed)); // acq_rel: carries earlier producers' writes along
+		return head == nullptr;
+	}
+
+	// Detach everything queued so far, oldest first; nullptr when empty.
+	T* take_all()
+	{
+		T* head = top.exchange(nullptr, std::memory_order_acquire);
+		T* fifo = nullptr;
+		while (head)
+		{
+			T* n = head->next;
+			head->next = fifo;
+			fifo = head;
+			head = n;
+		}
+		return fifo;
+	}
+
+	bool empty() const { return top.load(std::memory_order_relaxed) == nullptr; }
+
+  private:
+	std::atomic<T*> top{ nullptr }; // newest node, links run towards older ones
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,371 @@
+#include "multipart.h"
+#include "config.h"
+#include <cctype>
+#include <cstring>
+
+static const size_t MAX_PART_HEADER = 16 * 1024;
+
+static void trim_blanks(std::string& s)
+{
+	size_t b = s.find_first_not_of(" \t");
+	if (b == std::string::npos)
+	{
+		s.clear();
+		return;
+	}
+	s.erase(s.find_last_not_of(" \t") + 1);
+	s.erase(0, b);
+}
+
+std::string multipart_form_boundary(std::string_view content_type)
+{
+	std::string lct(content_type);
+	for (auto& c : lct)
+		c = std::tolower((unsigned char)c);
+	if (lct.find("multipart/form-data") == std::string::npos)
+		return "";
+	const std::string key = "boundary=";
+	size_t bpos = lct.find(key);
+	if (bpos == std::string::npos)
+		return "";
+	std::string boundary(content_type.substr(bpos + key.size()));
+	size_t semi = boundary.find(';');
+	if (semi != std::string::npos)
+		boundary.resize(semi);
+	trim_blanks(boundary);
+	if (boundary.size() >= 2 && boundary.front() == '"' && boundary.back() == '"')
+		boundary = boundary.substr(1, boundary.size() - 2);
+	return boundary;
+}
+
+MultipartParser::MultipartParser(const std::string& boundary, const std::string& dir)
+	: files(DynamicVariable::make_array()), upload_dir(dir)
+{
+	delim = "\r\n--" + boundary;
+	size_t m = delim.size();
+	for (size_t& s : skip)
+		s = m;
+	for (size_t i = 0; i + 1 < m; ++i)
+		skip[(uint8_t)delim[i]] = m - 1 - i;
+	carry = "\r\n"; // lets the first delimiter open the body without a CRLF in front
+	ContentHash::kind_from_name(global_config.upload_hash, hash_kind);
+}
+
+MultipartParser::~MultipartParser()
+{
+	discard_part();
+	if (global_config.keep_uploaded_files)
+		return;
+	for (Upload& u : uploads)
+		u.file->discard();
+	if (files.type != DynamicVariable::ARRAY)
+		return;
+	for (auto& f : files.data.a)
+	{
+		DynamicVariable* tp = f.type == DynamicVariable::OBJECT ? f.find("temp_path") : nullptr;
+		if (tp && tp->type == DynamicVariable::STRING && !tp->data.s.empty())
+			unlink_in_background(std::string(tp->data.s));
+	}
+}
+
+void MultipartParser::feed(const uint8_t* p, size_t n)
+{
+	while (n > 0)
+	{
+		size_t used;
+		switch (state)
+		{
+			case PREAMBLE:
+			case BODY:
+				used = scan(p, n);
+				break;
+			case DELIMITER_LINE:
+				used = read_delimiter_line(p, n);
+				break;
+			case HEADERS:
+				used = read_headers(p, n);
+				break;
+			default:
+				return; // epilogue or garbage after an error
+		}
+		p += used;
+		n -= used;
+	}
+}
+
+bool MultipartParser::finish()
+{
+	bool ok = state == DONE;
+	if (!ok)
+	{
+		if (state == BODY && file)
+		{
+			// cut short inside an upload: keep what arrived and report it as partial
+			part_data(reinterpret_cast<const uint8_t*>(carry.data()), carry.size());
+			carry.clear();
+			end_part();
+			uploads.back().truncated = true;
+		}
+		else
+			discard_part(); // a field cut short is not usable
+		state = FAILED;
+	}
+	for (Upload& u : uploads)
+	{
+		u.file->wait();
+		if (u.file->path().empty())
+			continue; // the temp file could not be created
+		DynamicVariable entry = DynamicVariable::make_object();
+		entry["field_name"] = u.name;
+		entry["filename"] = u.filename;
+		if (!u.content_type.empty())
+			entry["content_type"] = u.content_type;
+		entry["temp_path"] = u.file->path();
+		entry["size"] = (double)u.file->written();
+		entry["expected_size"] = (double)u.received;
+		if (hash_kind != ContentHash::NONE)
+			entry[std::string("hash_") + ContentHash::name(hash_kind)] = u.file->digest();
+		if (u.truncated || u.file->written() != u.received)
+			entry["partial"] = true;
+		files.push(std::move(entry));
+	}
+	uploads.clear(); // files owns the temp files now
+	return ok;
+}
+
+size_t MultipartParser::unwritten_bytes() const
+{
+	size_t n = file ? file->unwritten() : 0;
+	for (const Upload& u : uploads)
+		n += u.file->unwritten();
+	return n;
+}
+
+// Horspool: compare the window's last byte first and shift by the table on a miss.
+const uint8_t* MultipartParser::find_delimiter(const uint8_t* p, size_t n) const
+{
+	size_t m = delim.size();
+	if (n < m)
+		return nullptr;
+	const uint8_t* d = reinterpret_cast<const uint8_t*>(delim.data());
+	size_t last = m - 1;
+	for (size_t i = 0; i <= n - m; i += skip[p[i + last]])
+	{
+		if (p[i + last] == d[last] && std::memcmp(p + i, d, last) == 0)
+			return p + i;
+	}
+	return nullptr;
+}
+
+// Part content up to the next delimiter. The last delim.size() - 1 bytes of a
+// chunk are held back in carry since a delimiter may continue in the next one.
+size_t MultipartParser::scan(const uint8_t* p, size_t n)
+{
+	size_t m = delim.size();
+	if (!carry.empty())
+	{
+		const uint8_t* c = reinterpret_cast<const uint8_t*>(carry.data());
+		size_t cs = carry.size();
+		for (size_t i = 0; i < cs; ++i)
+		{
+			size_t k = cs - i; // delimiter bytes that would be in carry
+			if (std::memcmp(c + i, delim.data(), k) != 0)
+				continue;
+			size_t need = m - k;
+			if (n < need)
+			{
+				if (std::memcmp(p, delim.data() + k, n) != 0)
+					continue;
+				part_data(c, i); // still undecided, wait for more input
+				carry.erase(0, i);
+				carry.append(reinterpret_cast<const char*>(p), n);
+				return n;
+			}
+			if (std::memcmp(p, delim.data() + k, need) != 0)
+				continue;
+			part_data(c, i);
+			carry.clear();
+			if (state == BODY)
+				end_part();
+			state = DELIMITER_LINE;
+			return need;
+		}
+		part_data(c, cs);
+		carry.clear();
+	}
+	if (const uint8_t* hit = find_delimiter(p, n))
+	{
+		part_data(p, (size_t)(hit - p));
+		if (state == BODY)
+			end_part();
+		state = DELIMITER_LINE;
+		return (size_t)(hit - p) + m;
+	}
+	size_t keep = n < m - 1 ? n : m - 1;
+	part_data(p, n - keep);
+	carry.assign(reinterpret_cast<const char*>(p) + n - keep, keep);
+	return n;
+}
+
+// Rest of the delimiter line: "--" closes the body, otherwise optional blanks and CRLF.
+size_t MultipartParser::read_delimiter_line(const uint8_t* p, size_t n)
+{
+	size_t i = 0;
+	while (i < n)
+	{
+		uint8_t ch = p[i++];
+		if (line_cr)
+		{
+			line_cr = line_dash = false;
+			state = ch == '\n' ? HEADERS : FAILED;
+			return i;
+		}
+		if (ch == '-' && !line_dash)
+			line_dash = true;
+		else if (line_dash)
+		{
+			state = ch == '-' ? DONE : FAILED;
+			return n; // the epilogue is ignored
+		}
+		else if (ch == '\r')
+			line_cr = true;
+		else if (ch != ' ' && ch != '\t')
+		{
+			state = FAILED;
+			return n;
+		}
+	}
+	return i;
+}
+
+size_t MultipartParser::read_headers(const uint8_t* p, size_t n)
+{
+	size_t old = header.size();
+	size_t take = n < MAX_PART_HEADER - old ? n : MAX_PART_HEADER - old;
+	header.append(reinterpret_cast<const char*>(p), take);
+	size_t end = std::string::npos;
+	if (header.size() >= 2 && header[0] == '\r' && header[1] == '\n')
+		end = 2; // part without headers
+	else
+	{
+		size_t f = header.find("\r\n\r\n", old > 3 ? old - 3 : 0);
+		if (f != std::string::npos)
+			end = f + 4;
+	}
+	if (end == std::string::npos)
+	{
+		if (header.size() >= MAX_PART_HEADER)
+			state = FAILED;
+		return take;
+	}
+	header.resize(end);
+	begin_part();
+	header.clear();
+	state = BODY;
+	return end - old;
+}
+
+void MultipartParser::begin_part()
+{
+	name.clear();
+	filename.clear();
+	content_type.clear();
+	value.clear();
+	received = 0;
+	size_t hpos = 0;
+	while (hpos < header.size())
+	{
+		size_t line_end = header.find("\r\n", hpos);
+		if (line_end == std::string::npos)
+			line_end = header.size();
+		std::string line = header.substr(hpos, line_end - hpos);
+		hpos = line_end + 2;
+		if (line.empty())
+			break;
+		auto colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string hname = line.substr(0, colon);
+		std::string hvalue = line.substr(colon + 1);
+		trim_blanks(hvalue);
+		for (auto& c : hname)
+			c = std::tolower((unsigned char)c);
+		if (hname == "content-disposition")
+		{
+			size_t pos = 0;
+			while (pos < hvalue.size())
+			{
+				size_t sc = hvalue.find(';', pos);
+				if (sc == std::string::npos)
+					sc = hvalue.size();
+				size_t eqp = hvalue.find('=', pos);
+				if (eqp != std::string::npos && eqp < sc)
+				{
+					std::string attr = hvalue.substr(pos, eqp - pos);
+					trim_blanks(attr);
+					size_t vs = eqp + 1;
+					while (vs < sc && (hvalue[vs] == ' ' || hvalue[vs] == '\t'))
+						++vs;
+					if (vs < sc && hvalue[vs] == '"' && sc > vs + 1 && hvalue[sc - 1] == '"')
+					{
+						std::string aval = hvalue.substr(vs + 1, sc - vs - 2);
+						if (attr == "name")
+							name = aval;
+						else if (attr == "filename")
+							filename = aval;
+					}
+				}
+				pos = sc + 1;
+			}
+		}
+		else if (hname == "content-type")
+		{
+			content_type = hvalue;
+		}
+	}
+	if (!filename.empty())
+		file.reset(new BackgroundFile(upload_dir, "fcgi_upload_", false, hash_kind));
+}
+
+void MultipartParser::part_data(const uint8_t* p, size_t n)
+{
+	if (state != BODY || n == 0)
+		return;
+	received += n;
+	if (file)
+		file->write(p, n);
+	else if (filename.empty())
+	{
+		if (field_bytes + name.size() + value.size() + n > global_config.max_params_bytes)
+		{
+			discard_part(); // plain fields stay in memory, so they share the params limit
+			state = FAILED;
+			overflowed = true;
+			return;
+		}
+		value.append(reinterpret_cast<const char*>(p), n);
+	}
+}
+
+void MultipartParser::end_part()
+{
+	if (filename.empty())
+	{
+		field_bytes += name.size() + value.size();
+		fields[name] = std::move(value);
+		value.clear();
+		return;
+	}
+	file->close();
+	uploads.push_back(Upload{ name, filename, content_type, received, std::move(file) });
+}
+
+void MultipartParser::discard_part()
+{
+	if (file)
+	{
+		file->discard();
+		file.reset();
+	}
+	value.clear();
+}
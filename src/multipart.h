@@ -0,0 +1,95 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "dynamic_variable.h"
+#include "fileops.h"
+
+// Boundary of a multipart/form-data Content-Type; empty for anything else.
+std::string multipart_form_boundary(std::string_view content_type);
+
+// Incremental multipart/form-data parser. feed() takes the body in whatever
+// chunks it arrives in. Delimiters are located with a Boyer-Moore-Horspool
+// scan. File parts stream into a temp file under upload_dir, written and hashed
+// in one pass by the file executor, so an upload is never held in memory as a
+// whole and the feeding IO thread never touches the disk. finish() waits for
+// those writes and fills files, so it belongs on a worker thread. Temp files
+// still owned by the parser when it is destroyed are removed unless
+// keep_uploaded_files is set; take them over by moving files out.
+class MultipartParser
+{
+  public:
+	MultipartParser(const std::string& boundary, const std::string& upload_dir);
+	~MultipartParser();
+	MultipartParser(const MultipartParser&) = delete;
+	MultipartParser& operator=(const MultipartParser&) = delete;
+
+	void feed(const uint8_t* data, size_t len);
+	// End of input: describes the uploads in files. A field cut short is dropped,
+	// an upload cut short keeps what arrived and is marked partial. False if the
+	// body was malformed or had no closing delimiter.
+	bool finish();
+
+	size_t memory_bytes() const { return header.size() + value.size() + field_bytes; }
+	// Plain fields went past max_params_bytes; the rest of the body is ignored.
+	bool fields_too_large() const { return overflowed; }
+	size_t unwritten_bytes() const; // upload data queued for the disk
+
+	std::unordered_map<std::string, std::string> fields; // plain form fields
+	DynamicVariable files; // one object per uploaded file
+
+  private:
+	enum State
+	{
+		PREAMBLE,
+		DELIMITER_LINE, // after a delimiter: "--" ends the body, CRLF starts a part
+		HEADERS,
+		BODY,
+		DONE,
+		FAILED
+	};
+
+	const uint8_t* find_delimiter(const uint8_t* p, size_t n) const;
+	size_t scan(const uint8_t* p, size_t n); // PREAMBLE/BODY: returns bytes consumed
+	size_t read_delimiter_line(const uint8_t* p, size_t n);
+	size_t read_headers(const uint8_t* p, size_t n);
+	void part_data(const uint8_t* p, size_t n);
+	void begin_part();
+	void end_part();
+	void discard_part();
+
+	struct Upload
+	{
+		std::string name, filename, content_type;
+		size_t received;
+		std::unique_ptr<BackgroundFile> file;
+		bool truncated = false; // the body ended inside this part
+	};
+
+	std::string delim; // CRLF "--" boundary
+	size_t skip[256]; // Horspool shift table for delim
+	std::string upload_dir;
+	ContentHash::Kind hash_kind = ContentHash::XXH3; // upload_hash
+	State state = PREAMBLE;
+	std::string carry; // tail of the last chunk that may start a delimiter
+	std::string header; // header block of the current part
+	bool line_dash = false; // DELIMITER_LINE: saw the first '-'
+	bool line_cr = false; // DELIMITER_LINE: saw CR
+
+	// current part
+	std::string name, filename, content_type;
+	std::string value; // plain field value
+	std::unique_ptr<BackgroundFile> file; // temp file of a file part
+	size_t received = 0; // part bytes seen
+	size_t field_bytes = 0;
+	bool overflowed = false; // see fields_too_large()
+	std::vector<Upload> uploads; // complete file parts, described by finish()
+};
+
+#endif // MULTIPART_H
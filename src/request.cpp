@@ -1,17 +1,122 @@
 #include "request.h"
+#include <algorithm>
 
+// The containers a recycled request keeps, with the elements they are sized for
+// up front. A request that outgrows one is rebuilt, and the rebuilt ones are
+// sized for what it needed, up to KEEP_LIMIT.
+static DynamicVariable Request::* const KEPT[] = { &Request::env, &Request::params, &Request::cookies, &Request::headers, &Request::session, &Request::context, &Request::files };
+static const uint32_t KEPT_RESERVE[] = { 48, 16, 8, 16, 8, 8, 4 };
+static const size_t KEPT_COUNT = sizeof(KEPT) / sizeof(KEPT[0]);
+static const size_t FILES = KEPT_COUNT - 1; // the only array
+static const uint32_t KEEP_LIMIT = 128;
+static const size_t SESSION_ID_RESERVE = 64;
+static std::atomic<uint32_t> kept_learned[KEPT_COUNT];
+
+// Every member that allocates is handed the arena, so releasing the request
+// frees them all with the one Arena::reset().
 Request::Request(Arena* ar)
+	: arena(ar), memory(ar),
+	  env(DynamicVariable::allocator_type(&memory)), params(DynamicVariable::allocator_type(&memory)),
+	  cookies(DynamicVariable::allocator_type(&memory)), headers(DynamicVariable::allocator_type(&memory)),
+	  files(DynamicVariable::allocator_type(&memory)), session(DynamicVariable::allocator_type(&memory)),
+	  context(DynamicVariable::allocator_type(&memory)), session_id(&memory), body(&memory)
+{
+	for (size_t i = 0; i < KEPT_COUNT; ++i)
+	{
+		DynamicVariable& v = this->*KEPT[i];
+		size_t n = std::max(KEPT_RESERVE[i], kept_learned[i].load(std::memory_order_relaxed));
+		if (i == FILES)
+		{
+			v = DynamicVariable::make_array();
+			v.data.a.reserve(n);
+		}
+		else
+		{
+			v = DynamicVariable::make_object();
+			v.data.o.reserve(n);
+		}
+	}
+	session_id.reserve(SESSION_ID_RESERVE);
+}
+
+Request* Request::acquire(Arena* a, uint64_t now_ms)
+{
+	Request* r = static_cast<Request*>(a->resident);
+	if (!r)
+	{
+		void* mem = a->alloc(sizeof(Request), alignof(Request));
+		if (!mem)
+			return nullptr;
+		r = new (mem) Request(a);
+		if (!a->chain) // all of it in data, so it survives a reset
+		{
+			a->mark = a->offset;
+			a->resident = r;
+		}
+	}
+	r->start_time_sec = (now_ms ? now_ms : monotonic_ms()) / 1000.0;
+	r->env["DBG_ARENA"] = (double)a->management_flag;
+	return r;
+}
+
+void Request::retire(Request* r)
+{
+	Arena* a = r->arena;
+	if (a && a->resident == r)
+	{
+		if (r->recycle())
+			return;
+		a->resident = nullptr;
+		a->mark = 0;
+	}
+	r->~Request();
+}
+
+// Clears everything for the next request. The kept containers only drop their
+// elements, which live past the mark; anything else that allocated gives its
+// memory back first, since the rewind would leave it dangling.
+bool Request::recycle()
 {
-	arena = ar;
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	start_time_sec = ts.tv_sec + ts.tv_nsec / 1e9;
-	env = DynamicVariable::make_object();
-	env["DBG_ARENA"] = DynamicVariable::make_number(arena->management_flag);
-	params = DynamicVariable::make_object();
-	cookies = DynamicVariable::make_object();
-	headers = DynamicVariable::make_object();
-	files = DynamicVariable::make_array();
-	session = DynamicVariable::make_object();
-	context = DynamicVariable::make_object();
+	bool intact = !memory.kept_released && !deadline.armed() && session_id.capacity() <= SESSION_ID_RESERVE;
+	for (size_t i = 0; i < KEPT_COUNT; ++i)
+	{
+		const DynamicVariable& v = this->*KEPT[i];
+		if (v.type != (i == FILES ? DynamicVariable::ARRAY : DynamicVariable::OBJECT))
+		{
+			intact = false;
+			continue;
+		}
+		uint32_t n = (uint32_t)std::min<size_t>(i == FILES ? v.data.a.size() : v.data.o.size(), KEEP_LIMIT);
+		uint32_t seen = kept_learned[i].load(std::memory_order_relaxed);
+		while (n > seen && !kept_learned[i].compare_exchange_weak(seen, n, std::memory_order_relaxed))
+		{
+		}
+	}
+	if (!intact)
+		return false;
+	for (size_t i = 0; i < KEPT_COUNT; ++i)
+	{
+		DynamicVariable& v = this->*KEPT[i];
+		if (i == FILES)
+			v.data.a.clear();
+		else
+			v.data.o.clear();
+	}
+	session_id.clear();
+	body.release();
+	multipart.reset();
+	if (memory.kept_released) // an element's destructor let go of kept memory
+		return false;
+	id = 0;
+	conn_ptr = nullptr;
+	worker_active.store(false, std::memory_order_relaxed);
+	start_time_sec = 0.0;
+	deadline = TimerNode();
+	work = TaskNode();
+	cancel.reset();
+	flags = 0;
+	params_bytes = 0;
+	body_bytes = 0;
+	body_limit = 0;
+	return true;
 }
@@ -4,19 +4,38 @@
 #include <cstdint>
 #include <string>
 #include <atomic>
+#include <memory>
 #include "dynamic_variable.h"
 #include "memory.h"
+#include "timer_wheel.h"
+#include "request_body.h"
+#include "multipart.h"
+#include "task.h"
 
 struct Request
 {
 	uint16_t id = 0;
 	Arena* arena = nullptr;
+	ArenaResource memory; // the containers below allocate from arena through this
 	void* conn_ptr = nullptr; // owning connection (internal)
 	std::atomic<bool> worker_active{ false }; // set true while worker handler runs
 	double start_time_sec = 0.0; // monotonic start time
+	TimerNode deadline; // max_request_time, on the owning reactor's wheel
+	TaskNode work; // the handler run, queued on the worker pool without allocating
+	CancelToken cancel; // set once nobody waits for the response; long handlers should poll it
 
 	Request(Arena* ar);
 
+	// A request is built once per arena and then recycled in place: the object
+	// and its empty containers, hash buckets included, stay at the start of the
+	// arena below its mark, and releasing the arena only rewinds to there.
+	// acquire() hands out the arena's request, building it on first use (nullptr
+	// if it does not fit); now_ms is the caller's monotonic clock if it has one.
+	// retire() goes before the arena is released: it clears the request for the
+	// next one, or destroys it if a kept container was replaced or outgrown.
+	static Request* acquire(Arena* a, uint64_t now_ms = 0);
+	static void retire(Request* r);
+
 	enum RequestFlags : uint64_t
 	{
 		INITIALIZED = 1ULL << 0, // request has been initialized
@@ -36,10 +55,15 @@ struct Request
 	DynamicVariable files;
 	DynamicVariable session;
 	DynamicVariable context;
-	std::string session_id;
-	std::string body;
+	std::pmr::string session_id;
+	RequestBody body; // FCGI_STDIN, spilled to upload_tmp_dir past body_memory_limit
+	std::unique_ptr<MultipartParser> multipart; // multipart/form-data is parsed as it arrives instead
 	size_t params_bytes = 0;
 	size_t body_bytes = 0;
+	size_t body_limit = 0; // set from the content type once the params are in, 0 until then
+
+  private:
+	bool recycle();
 };
 
 #endif
@@ -0,0 +1,116 @@
+#include "request_body.h"
+#include "config.h"
+#include "logger.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+RequestBody::~RequestBody()
+{
+	clear();
+}
+
+// Past the memory limit everything, the in-memory part included, goes to the
+// spill file so it can be mapped as one piece later.
+void RequestBody::append(const void* data, size_t len)
+{
+	if (!file)
+	{
+		if (head.size() + len <= global_config.body_memory_limit)
+		{
+			head.append(static_cast<const char*>(data), len);
+			total += len;
+			return;
+		}
+		file.reset(new BackgroundFile(global_config.upload_tmp_dir, "fcgi_body_", true));
+		file->write(head.data(), head.size());
+	}
+	unmap();
+	file->write(data, len);
+	total += len;
+}
+
+void RequestBody::assign(std::string_view data)
+{
+	clear();
+	head.assign(data.data(), data.size());
+	total = head.size();
+}
+
+void RequestBody::reserve(size_t len)
+{
+	if (!file)
+		head.reserve(len < global_config.body_memory_limit ? len : global_config.body_memory_limit);
+}
+
+void RequestBody::clear()
+{
+	unmap();
+	file.reset(); // the close is queued
+	head.clear();
+	total = 0;
+}
+
+void RequestBody::release()
+{
+	clear();
+	std::pmr::string(head.get_allocator()).swap(head);
+}
+
+std::string_view RequestBody::view() const
+{
+	if (!file)
+		return head;
+	if (!map && total > 0)
+	{
+		file->wait();
+		if (file->failed())
+			return {};
+		void* m = mmap(nullptr, total, PROT_READ, MAP_PRIVATE, file->fd(), 0);
+		if (m == MAP_FAILED)
+		{
+			log_error("Body mmap failed: %s", std::strerror(errno));
+			return {};
+		}
+		madvise(m, total, MADV_SEQUENTIAL);
+		map = m;
+		mapped = total;
+	}
+	return std::string_view(static_cast<const char*>(map), mapped);
+}
+
+size_t RequestBody::read(size_t offset, void* dst, size_t len) const
+{
+	if (offset >= total)
+		return 0;
+	if (len > total - offset)
+		len = total - offset;
+	if (!file)
+	{
+		std::memcpy(dst, head.data() + offset, len);
+		return len;
+	}
+	file->wait();
+	size_t done = 0;
+	while (!file->failed() && done < len)
+	{
+		ssize_t n = ::pread(file->fd(), static_cast<char*>(dst) + done, len - done, (off_t)(offset + done));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += (size_t)n;
+	}
+	return done;
+}
+
+void RequestBody::unmap() const
+{
+	if (map)
+	{
+		munmap(map, mapped);
+		map = nullptr;
+		mapped = 0;
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef REQUEST_BODY_H
+#define REQUEST_BODY_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include "fileops.h"
+
+// FCGI_STDIN of one request. The first body_memory_limit bytes are kept in
+// memory; a larger body moves to an unlinked temp file under upload_tmp_dir, so
+// it costs page cache instead of resident heap. The file is written by the file
+// executor. Readers use view() (mmap'ed once spilled) or read(), which wait for
+// those writes. Filled on the IO thread, read by the worker.
+class RequestBody
+{
+  public:
+	explicit RequestBody(std::pmr::memory_resource* mr = std::pmr::get_default_resource()) : head(mr) {}
+	~RequestBody();
+	RequestBody(const RequestBody&) = delete;
+	RequestBody& operator=(const RequestBody&) = delete;
+
+	void append(const void* data, size_t len);
+	void reserve(size_t len); // room for the in-memory part of a body of len bytes
+	void assign(std::string_view data); // replace with in-memory content, no limit applied
+	void clear();
+	void release(); // clear() and give the in-memory buffer back too
+
+	size_t size() const { return total; }
+	bool empty() const { return total == 0; }
+	bool spilled() const { return file != nullptr; }
+	size_t memory_bytes() const { return head.size(); }
+	size_t unwritten_bytes() const { return file ? file->unwritten() : 0; } // queued for the spill file
+
+	// The in-memory prefix (the whole body unless spilled).
+	std::string_view memory() const { return head; }
+	// The whole body, mapping the spill file on first use; empty if the file failed.
+	// Valid until the next append() or clear().
+	std::string_view view() const;
+	// Copy up to len bytes from offset; returns the count copied.
+	size_t read(size_t offset, void* dst, size_t len) const;
+
+  private:
+	void unmap() const;
+
+	std::pmr::string head; // in the request arena
+	size_t total = 0;
+	std::unique_ptr<BackgroundFile> file; // spill file holding the whole body
+	mutable void* map = nullptr;
+	mutable size_t mapped = 0;
+};
+
+#endif // REQUEST_BODY_H
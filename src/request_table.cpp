@@ -0,0 +1,61 @@
+#include "request_table.h"
+#include <cstring>
+
+static const size_t INITIAL_SLOTS = 8;
+
+void RequestTable::insert(uint16_t id, Request* r)
+{
+	if ((count + 1) * 2 > capacity())
+		grow(); // keep probe runs short
+	size_t i = id & mask;
+	while (used(i))
+		i = (i + 1) & mask;
+	ids[i] = id;
+	reqs[i] = r;
+	bits[i >> 6] |= 1ULL << (i & 63);
+	++count;
+}
+
+void RequestTable::clear()
+{
+	if (bits)
+		std::memset(bits.get(), 0, ((capacity() + 63) / 64) * sizeof(uint64_t));
+	count = 0;
+}
+
+// Backward-shift delete: pull later entries of the probe run into the hole unless
+// that would move them in front of their home slot.
+void RequestTable::erase_at(size_t i)
+{
+	bits[i >> 6] &= ~(1ULL << (i & 63));
+	--count;
+	size_t hole = i;
+	for (size_t j = (i + 1) & mask; used(j); j = (j + 1) & mask)
+	{
+		size_t home = ids[j] & mask;
+		if (((j - home) & mask) < ((j - hole) & mask))
+			continue; // home lies between the hole and j
+		ids[hole] = ids[j];
+		reqs[hole] = reqs[j];
+		bits[hole >> 6] |= 1ULL << (hole & 63);
+		bits[j >> 6] &= ~(1ULL << (j & 63));
+		hole = j;
+	}
+}
+
+void RequestTable::grow()
+{
+	size_t old_cap = capacity();
+	size_t cap = old_cap ? old_cap * 2 : INITIAL_SLOTS;
+	std::unique_ptr<uint16_t[]> old_ids(std::move(ids));
+	std::unique_ptr<Request*[]> old_reqs(std::move(reqs));
+	std::unique_ptr<uint64_t[]> old_bits(std::move(bits));
+	ids.reset(new uint16_t[cap]);
+	reqs.reset(new Request*[cap]);
+	bits.reset(new uint64_t[(cap + 63) / 64]());
+	mask = cap - 1;
+	count = 0;
+	for (size_t i = 0; i < old_cap; ++i)
+		if ((old_bits[i >> 6] >> (i & 63)) & 1)
+			insert(old_ids[i], old_reqs[i]);
+}
@@ -0,0 +1,97 @@
+#ifndef REQUEST_TABLE_H
+#define REQUEST_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct Request;
+
+// Live requests of one FastCGI connection, keyed by request ID. Clients number
+// multiplexed requests densely from 1, so an ID's home slot (id & mask) is almost
+// always the one it sits in. Collisions probe linearly and erase shifts entries
+// back instead of leaving tombstones. An occupancy bitmap lets scans skip empty
+// slots a word at a time. Not thread-safe: owned by the connection's IO thread.
+class RequestTable
+{
+  public:
+	class iterator
+	{
+	  public:
+		iterator(const RequestTable* t, size_t i) : table(t), index(i) {}
+		Request* operator*() const { return table->reqs[index]; }
+		iterator& operator++()
+		{
+			index = table->next_used(index + 1);
+			return *this;
+		}
+		bool operator!=(const iterator& o) const { return index != o.index; }
+
+	  private:
+		const RequestTable* table;
+		size_t index;
+	};
+
+	RequestTable() = default;
+	RequestTable(const RequestTable&) = delete;
+	RequestTable& operator=(const RequestTable&) = delete;
+
+	Request* find(uint16_t id) const
+	{
+		if (count == 0)
+			return nullptr;
+		for (size_t i = id & mask; used(i); i = (i + 1) & mask)
+			if (ids[i] == id)
+				return reqs[i];
+		return nullptr;
+	}
+
+	void insert(uint16_t id, Request* r); // id must not be present
+	void clear(); // keeps the storage for the next request on the connection
+
+	// Erase every request pred(Request*) returns true for. pred may run more than
+	// once for a request it keeps, when an erase shifts that request back.
+	template <typename F>
+	void erase_if(F&& pred)
+	{
+		for (size_t i = next_used(0); i < capacity();)
+		{
+			if (pred(reqs[i]))
+				erase_at(i);
+			else
+				++i;
+			i = next_used(i); // re-checks i: a later entry may have moved into it
+		}
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	iterator begin() const { return iterator(this, next_used(0)); }
+	iterator end() const { return iterator(this, capacity()); }
+
+  private:
+	size_t capacity() const { return ids ? mask + 1 : 0; }
+	bool used(size_t i) const { return (bits[i >> 6] >> (i & 63)) & 1; }
+	size_t next_used(size_t i) const
+	{
+		size_t cap = capacity();
+		while (i < cap)
+		{
+			uint64_t word = bits[i >> 6] >> (i & 63);
+			if (word)
+				return i + (size_t)__builtin_ctzll(word);
+			i = (i | 63) + 1;
+		}
+		return cap;
+	}
+	void erase_at(size_t i);
+	void grow();
+
+	std::unique_ptr<uint16_t[]> ids;
+	std::unique_ptr<Request*[]> reqs;
+	std::unique_ptr<uint64_t[]> bits; // occupancy, one bit per slot
+	size_t mask = 0; // capacity - 1 once allocated
+	size_t count = 0;
+};
+
+#endif // REQUEST_TABLE_H
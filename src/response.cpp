@@ -0,0 +1,96 @@
+#include "response.h"
+#include "fastcgi.h"
+#include "config.h"
+
+ResponseWriter::ResponseWriter(Request& r, ResponseSink& s)
+	: std::ostream(this), req(r), sink(&s)
+{
+	buf.resize(global_config.output_buffer_initial ? global_config.output_buffer_initial : 4096);
+	setp(buf.data(), buf.data() + buf.size());
+}
+
+ResponseWriter::ResponseWriter(Request& r, std::vector<uint8_t>& out)
+	: std::ostream(this), req(r), collect(&out)
+{
+	buf.resize(global_config.output_buffer_initial ? global_config.output_buffer_initial : 4096);
+	setp(buf.data(), buf.data() + buf.size());
+}
+
+ResponseWriter::~ResponseWriter()
+{
+	finish();
+}
+
+void ResponseWriter::write(const void* data, size_t len)
+{
+	xsputn(static_cast<const char*>(data), (std::streamsize)len);
+}
+
+ResponseWriter::int_type ResponseWriter::overflow(int_type ch)
+{
+	flush();
+	if (traits_type::eq_int_type(ch, traits_type::eof()))
+		return traits_type::not_eof(ch);
+	*pptr() = traits_type::to_char_type(ch);
+	pbump(1);
+	return ch;
+}
+
+int ResponseWriter::sync()
+{
+	flush();
+	return 0;
+}
+
+// Encode the put area (plus the terminating records when last) and hand it on.
+void ResponseWriter::emit(bool last, uint32_t app_status)
+{
+	size_t len = (size_t)(pptr() - pbase());
+	setp(buf.data(), buf.data() + buf.size());
+	if (gone || (len == 0 && !last))
+		return;
+	std::vector<uint8_t> records;
+	records.reserve(len + (len / 0xFFFF + 3) * sizeof(fcgi::Header) + sizeof(fcgi::EndRequestBody));
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf.data());
+	for (size_t off = 0; off < len;)
+	{
+		uint16_t chunk = len - off > 0xFFFF ? 0xFFFF : (uint16_t)(len - off);
+		fcgi::append_record(records, fcgi::FCGI_STDOUT, req.id, p + off, chunk);
+		off += chunk;
+	}
+	total += len;
+	if (last)
+	{
+		fcgi::append_record(records, fcgi::FCGI_STDOUT, req.id, nullptr, 0);
+		fcgi::append_end_request(records, req.id, app_status, fcgi::REQUEST_COMPLETE);
+	}
+	if (collect)
+		collect->insert(collect->end(), records.begin(), records.end());
+	else
+		sink->push(std::move(records), last);
+}
+
+bool ResponseWriter::flush(bool block)
+{
+	if (done)
+		return !gone;
+	emit(false, 0);
+	if (gone || !sink)
+		return !gone;
+	size_t high = global_config.response_high_water;
+	if (high == 0 || sink->backlog() <= high)
+		return true;
+	if (!block)
+		return false;
+	if (!sink->wait_drained(high / 2))
+		gone = true;
+	return !gone;
+}
+
+void ResponseWriter::finish(uint32_t app_status)
+{
+	if (done)
+		return;
+	emit(true, app_status);
+	done = true;
+}
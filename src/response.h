@@ -0,0 +1,70 @@
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include "request.h"
+
+// Destination for the FastCGI records a ResponseWriter produces.
+struct ResponseSink
+{
+	virtual ~ResponseSink() = default;
+	// Take ownership of encoded records; last is set on the run carrying END_REQUEST.
+	virtual void push(std::vector<uint8_t>&& records, bool last) = 0;
+	// Bytes handed over but not yet written to the peer.
+	virtual size_t backlog() const = 0;
+	// Block until backlog() <= low or the peer is gone or the request cancelled;
+	// false in the latter two cases.
+	virtual bool wait_drained(size_t low) = 0;
+};
+
+// Incremental response for one request, used from the worker thread. Output is
+// buffered locally and each flush() turns it into FCGI_STDOUT records that the
+// IO thread ships right away. A full buffer flushes on its own, so handlers can
+// simply stream into it.
+class ResponseWriter : private std::streambuf, public std::ostream
+{
+  public:
+	ResponseWriter(Request& r, ResponseSink& sink); // stream to a connection
+	ResponseWriter(Request& r, std::vector<uint8_t>& out); // collect all records into out
+	~ResponseWriter();
+
+	ResponseWriter(const ResponseWriter&) = delete;
+	ResponseWriter& operator=(const ResponseWriter&) = delete;
+
+	void write(const void* data, size_t len);
+
+	// Hand buffered output to the sink. Over the high-water mark the producer
+	// blocks until the backlog halves, or with block=false returns false at once
+	// so it can yield. Also false once the peer is gone.
+	bool flush(bool block = true);
+
+	// Flush, then terminate the stream with an empty FCGI_STDOUT and END_REQUEST.
+	// Called by the server after the handler returns; later calls are no-ops.
+	void finish(uint32_t app_status = 0);
+
+	bool finished() const { return done; }
+	size_t bytes_written() const { return total; }
+
+  private:
+	using int_type = std::streambuf::int_type; // both bases define these
+	using traits_type = std::streambuf::traits_type;
+
+	int_type overflow(int_type ch) override;
+	int sync() override;
+
+	void emit(bool last, uint32_t app_status);
+
+	Request& req;
+	ResponseSink* sink = nullptr;
+	std::vector<uint8_t>* collect = nullptr;
+	std::vector<char> buf; // put area
+	size_t total = 0; // body bytes emitted so far
+	bool done = false;
+	bool gone = false; // peer disconnected, output is discarded
+};
+
+#endif // RESPONSE_H
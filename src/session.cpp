@@ -11,12 +11,13 @@
 #include <chrono>
 #include <fstream>
 
-static std::string session_path(const std::string& id)
+static std::string session_path(std::string_view id)
 {
 	std::string dir = global_config.session_storage_path;
 	if (!dir.empty() && dir.back() != '/')
 		dir.push_back('/');
-	return dir + id + ".json";
+	dir.append(id);
+	return dir + ".json";
 }
 
 static bool mkdir_if_not_exists(const std::string& dir)
@@ -59,11 +60,11 @@ static std::string random_hex(size_t bytes)
 std::string session_get_id(Request& r, bool create)
 {
 	if (!r.session_id.empty())
-		return r.session_id;
+		return std::string(r.session_id);
 	if (!create)
 		return std::string();
 	r.session_id = random_hex(16);
-	return r.session_id;
+	return std::string(r.session_id);
 }
 
 bool session_load(Request& r)
@@ -75,11 +76,18 @@ bool session_load(Request& r)
 	if (content.empty())
 		return false;
 
-	DynamicVariable parsed;
+	DynamicVariable parsed(r.session.get_allocator());
 	size_t err = 0;
 	if (parse_json(content, parsed, &err))
 	{
-		r.session = parsed;
+		if (parsed.type == DynamicVariable::OBJECT && r.session.type == DynamicVariable::OBJECT)
+		{
+			r.session.data.o.clear(); // moved over one by one, so the session keeps its buckets
+			for (auto& kv : parsed.data.o)
+				r.session[kv.first] = std::move(kv.second);
+		}
+		else
+			r.session = std::move(parsed);
 		return true;
 	}
 	return false;
@@ -89,9 +97,14 @@ bool session_start(Request& r)
 {
 	session_get_id(r, true);
 	if (!r.cookies.find(global_config.session_cookie_name))
-		r.headers["Set-Cookie"] = global_config.session_cookie_name + "=" + r.session_id + "; Path=/; HttpOnly";
+		r.headers["Set-Cookie"] = global_config.session_cookie_name + "=" + std::string(r.session_id) + "; Path=/; HttpOnly";
 	if (!session_load(r))
-		r.session.clear();
+	{
+		if (r.session.type == DynamicVariable::OBJECT)
+			r.session.data.o.clear(); // an empty session, like session_clear() leaves
+		else
+			r.session = DynamicVariable::make_object();
+	}
 	return true;
 }
 
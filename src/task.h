@@ -0,0 +1,141 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable with inline storage. Unlike std::function it never
+// allocates: a callable that does not fit INLINE_SIZE is a compile error, so
+// keep captures to a few pointers and move bigger state into the Request.
+class Task
+{
+  public:
+	static constexpr size_t INLINE_SIZE = 48;
+
+	Task() = default;
+	Task(std::nullptr_t) {}
+
+	template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task> && !std::is_same_v<std::decay_t<F>, std::nullptr_t>>>
+	Task(F&& f)
+	{
+		using Fn = std::decay_t<F>;
+		static_assert(sizeof(Fn) <= INLINE_SIZE, "Task capture too large for the inline storage");
+		static_assert(alignof(Fn) <= alignof(std::max_align_t), "Task capture over-aligned");
+		static_assert(std::is_nothrow_move_constructible_v<Fn>, "Task callables must move without throwing");
+		new (storage) Fn(std::forward<F>(f));
+		ops = &OpsFor<Fn>::table;
+	}
+
+	Task(Task&& o) noexcept { take(o); }
+	Task& operator=(Task&& o) noexcept
+	{
+		if (this != &o)
+		{
+			reset();
+			take(o);
+		}
+		return *this;
+	}
+	Task& operator=(std::nullptr_t) noexcept
+	{
+		reset();
+		return *this;
+	}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task() { reset(); }
+
+	explicit operator bool() const { return ops != nullptr; }
+	void operator()() { ops->call(storage); }
+
+	void reset()
+	{
+		if (ops)
+		{
+			ops->destroy(storage);
+			ops = nullptr;
+		}
+	}
+
+  private:
+	struct Ops
+	{
+		void (*call)(void*);
+		void (*move)(void* dst, void* src); // move-construct into dst and destroy src
+		void (*destroy)(void*);
+	};
+
+	template <typename Fn>
+	struct OpsFor
+	{
+		static void call(void* p) { (*static_cast<Fn*>(p))(); }
+		static void move(void* dst, void* src)
+		{
+			new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+			static_cast<Fn*>(src)->~Fn();
+		}
+		static void destroy(void* p) { static_cast<Fn*>(p)->~Fn(); }
+		static constexpr Ops table{ &call, &move, &destroy };
+	};
+
+	void take(Task& o)
+	{
+		if (o.ops)
+		{
+			o.ops->move(storage, o.storage);
+			ops = o.ops;
+			o.ops = nullptr;
+		}
+	}
+
+	alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+	const Ops* ops = nullptr;
+};
+
+// Scheduling class; the worker pool shares its time between them by weight.
+enum TaskClass : uint8_t
+{
+	TASK_REQUEST, // FastCGI requests
+	TASK_HTTP, // plain HTTP on the WebSocket port
+	TASK_MESSAGE, // WebSocket messages
+	TASK_CLASSES
+};
+
+// Set by whoever finds the work pointless (timed out, aborted, client gone) and
+// read by the worker pool before a task starts and by long handlers while they run.
+class CancelToken
+{
+  public:
+	void cancel() { flag.store(true, std::memory_order_release); }
+	bool cancelled() const { return flag.load(std::memory_order_acquire); }
+	void reset() { flag.store(false, std::memory_order_relaxed); } // only while nobody else holds it
+
+  private:
+	std::atomic<bool> flag{ false };
+};
+
+// A Task with the link the worker pool queues it by. Embed one in whatever the
+// task works on (Request has one) and submitting it costs no allocation.
+struct TaskNode
+{
+	Task fn;
+	TaskNode* next = nullptr;
+	const CancelToken* token = nullptr; // once cancelled the task is dropped unrun
+	uint64_t deadline_ms = 0; // monotonic_ms() past which it is dropped unrun, 0 for none
+	void (*on_drop)(void* owner) = nullptr; // runs instead of a dropped task, to let go of owner
+	void* owner = nullptr;
+	uint32_t tenant = 0; // tasks of one class are fair-queued by tenant
+	TaskClass task_class = TASK_REQUEST;
+	bool owned = false; // allocated by WorkerPool::enqueue(Task), freed after it runs
+
+	bool expired(uint64_t now_ms) const
+	{
+		return (token && token->cancelled()) || (deadline_ms && now_ms >= deadline_ms);
+	}
+};
+
+#endif // TASK_H
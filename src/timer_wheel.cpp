@@ -0,0 +1,101 @@
+#include "timer_wheel.h"
+#include <time.h>
+
+uint64_t monotonic_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+TimerWheel::TimerWheel(uint32_t tick_ms)
+{
+	tick = tick_ms ? tick_ms : 1;
+	now_tick = monotonic_ms() / tick;
+	for (TimerNode& head : slots)
+		head.prev = head.next = &head;
+}
+
+void TimerWheel::schedule(TimerNode& t, uint64_t when_ms)
+{
+	if (t.armed())
+		cancel(t);
+	uint64_t at = (when_ms + tick - 1) / tick; // never fire early
+	t.expires = at > now_tick ? at : now_tick + 1;
+	link(t);
+	++count;
+}
+
+void TimerWheel::cancel(TimerNode& t)
+{
+	if (!t.armed())
+		return;
+	t.prev->next = t.next;
+	t.next->prev = t.prev;
+	TimerNode& head = slots[t.slot];
+	if (head.next == &head)
+		occupied[t.slot / SLOTS] &= ~(1ULL << (t.slot % SLOTS));
+	t.prev = t.next = nullptr;
+	--count;
+}
+
+// Level L covers deltas below SLOTS^(L+1) ticks; the index comes from the absolute
+// expiry so a slot is reached exactly when its timers have to move down.
+void TimerWheel::link(TimerNode& t)
+{
+	uint64_t delta = t.expires - now_tick;
+	unsigned level = 0;
+	while (level + 1 < LEVELS && delta >= (1ULL << (SLOT_BITS * (level + 1))))
+		++level;
+	uint64_t max_delta = (1ULL << (SLOT_BITS * LEVELS)) - 1;
+	if (delta > max_delta)
+		t.expires = now_tick + max_delta; // past the horizon: fires early, owners re-check
+	unsigned index = (unsigned)(t.expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+	t.slot = (uint16_t)(level * SLOTS + index);
+	TimerNode& head = slots[t.slot];
+	t.prev = head.prev;
+	t.next = &head;
+	head.prev->next = &t;
+	head.prev = &t;
+	occupied[level] |= 1ULL << index;
+}
+
+// Called after now_tick advanced: whenever a lower level wraps, redistribute the
+// current slot of the next level.
+void TimerWheel::cascade()
+{
+	for (unsigned level = 1; level < LEVELS; ++level)
+	{
+		uint64_t below = now_tick >> (SLOT_BITS * (level - 1));
+		if (below & (SLOTS - 1))
+			break; // level - 1 did not wrap
+		unsigned index = (unsigned)(now_tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+		TimerNode& head = slots[level * SLOTS + index];
+		while (head.next != &head)
+		{
+			TimerNode* t = head.next;
+			cancel(*t);
+			if (t->expires <= now_tick)
+				t->expires = now_tick; // fires in this tick's level-0 slot
+			link(*t);
+			++count;
+		}
+	}
+}
+
+uint64_t TimerWheel::next_timeout_ms(uint64_t now_ms) const
+{
+	if (count == 0)
+		return UINT64_MAX;
+	uint64_t ticks = SLOTS - (now_tick & (SLOTS - 1)); // next cascade
+	if (occupied[0])
+	{
+		unsigned from = (unsigned)((now_tick + 1) & (SLOTS - 1));
+		uint64_t rotated = (occupied[0] >> from) | (from ? occupied[0] << (SLOTS - from) : 0);
+		uint64_t d = (uint64_t)__builtin_ctzll(rotated) + 1;
+		if (d < ticks)
+			ticks = d;
+	}
+	uint64_t due = (now_tick + ticks) * tick;
+	return due > now_ms ? due - now_ms : 0;
+}
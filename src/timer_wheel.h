@@ -0,0 +1,80 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+uint64_t monotonic_ms();
+
+// Intrusive timer entry, embedded in the object that owns the timeout.
+struct TimerNode
+{
+	TimerNode* prev = nullptr;
+	TimerNode* next = nullptr;
+	uint64_t expires = 0; // absolute tick
+	uint16_t slot = 0; // level * SLOTS + index while armed
+	uint16_t kind = 0; // caller-defined timer type
+	void* owner = nullptr; // object the timer belongs to
+
+	bool armed() const { return prev != nullptr; }
+};
+
+// Hierarchical timing wheel: 4 levels of 64 slots with O(1) schedule and cancel.
+// Level 0 holds the next 64 ticks; later timers sit in coarser levels and cascade
+// down when their slot comes up, so advance() only touches what is due. Not
+// thread-safe: one wheel per IO loop.
+class TimerWheel
+{
+  public:
+	static const unsigned LEVELS = 4;
+	static const unsigned SLOT_BITS = 6;
+	static const unsigned SLOTS = 1u << SLOT_BITS;
+
+	explicit TimerWheel(uint32_t tick_ms);
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+
+	void schedule(TimerNode& t, uint64_t when_ms); // (re)arm for an absolute monotonic time
+	void schedule_in(TimerNode& t, uint64_t delay_ms) { schedule(t, monotonic_ms() + delay_ms); }
+	void cancel(TimerNode& t);
+
+	// Move time forward to now_ms, calling on_expire(TimerNode&) for every due
+	// timer. The node is unlinked first, so the callback may re-arm it.
+	template <typename F>
+	void advance(uint64_t now_ms, F&& on_expire)
+	{
+		uint64_t target = now_ms / tick;
+		if (count == 0 && target > now_tick)
+			now_tick = target; // nothing to cascade or fire
+		while (now_tick < target)
+		{
+			++now_tick;
+			cascade();
+			TimerNode& head = slots[now_tick & (SLOTS - 1)];
+			while (head.next != &head)
+			{
+				TimerNode* t = head.next;
+				cancel(*t);
+				on_expire(*t);
+			}
+		}
+	}
+
+	// Milliseconds from now_ms until advance() has work (a due slot or a cascade),
+	// or UINT64_MAX when no timer is armed.
+	uint64_t next_timeout_ms(uint64_t now_ms) const;
+
+	size_t size() const { return count; }
+
+  private:
+	void link(TimerNode& t);
+	void cascade();
+
+	TimerNode slots[LEVELS * SLOTS]; // list heads
+	uint64_t occupied[LEVELS] = {}; // non-empty slots per level
+	uint64_t now_tick = 0; // last processed tick
+	uint32_t tick = 1;
+	size_t count = 0;
+};
+
+#endif // TIMER_WHEEL_H
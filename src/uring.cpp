@@ -0,0 +1,312 @@
+#include "uring.h"
+
+#ifdef WASAPI_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+Uring::~Uring()
+{
+	destroy();
+}
+
+bool Uring::init(unsigned entries, unsigned cq_entries)
+{
+	io_uring_params p{};
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	p.cq_entries = cq_entries;
+	fd = sys_io_uring_setup(entries, &p);
+	if (fd < 0 && errno == EINVAL)
+	{
+		// pre-6.1 kernels: no single-issuer / deferred task work
+		p = io_uring_params{};
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = cq_entries;
+		fd = sys_io_uring_setup(entries, &p);
+	}
+	if (fd < 0)
+		return false;
+
+	sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+		sq_len = cq_len = sq_len > cq_len ? sq_len : cq_len;
+	sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ptr == MAP_FAILED)
+	{
+		sq_ptr = nullptr;
+		destroy();
+		return false;
+	}
+	if (single_mmap)
+		cq_ptr = sq_ptr;
+	else
+	{
+		cq_ptr = mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_ptr == MAP_FAILED)
+		{
+			cq_ptr = nullptr;
+			destroy();
+			return false;
+		}
+	}
+	sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+	void* s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (s == MAP_FAILED)
+	{
+		destroy();
+		return false;
+	}
+	sqes = (io_uring_sqe*)s;
+
+	uint8_t* sq = (uint8_t*)sq_ptr;
+	sq_head = (unsigned*)(sq + p.sq_off.head);
+	sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+	sq_entries = p.sq_entries;
+	unsigned* sq_array = (unsigned*)(sq + p.sq_off.array);
+	for (unsigned i = 0; i < sq_entries; ++i)
+		sq_array[i] = i; // sqes are used in ring order, so the indirection array is the identity
+	sqe_tail = *sq_tail;
+
+	uint8_t* cq = (uint8_t*)cq_ptr;
+	cq_head = (unsigned*)(cq + p.cq_off.head);
+	cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+	cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+	return true;
+}
+
+void Uring::destroy()
+{
+	if (sqes)
+		munmap(sqes, sqes_len);
+	if (cq_ptr && cq_ptr != sq_ptr)
+		munmap(cq_ptr, cq_len);
+	if (sq_ptr)
+		munmap(sq_ptr, sq_len);
+	if (fd >= 0)
+		::close(fd);
+	sqes = nullptr;
+	sq_ptr = cq_ptr = nullptr;
+	fd = -1;
+}
+
+io_uring_sqe* Uring::get_sqe()
+{
+	unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+	while (sqe_tail - head >= sq_entries)
+	{
+		if (submit(0) < 0)
+			return nullptr;
+		head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+	}
+	io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+	++sqe_tail;
+	std::memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+int Uring::submit(unsigned wait_nr)
+{
+	__atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+	unsigned to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+	// GETEVENTS even without waiting: with DEFER_TASKRUN completions are only posted from enter()
+	int ret = sys_io_uring_enter(fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS);
+	return ret < 0 ? -errno : ret;
+}
+
+io_uring_cqe* Uring::peek_cqe()
+{
+	unsigned head = *cq_head;
+	if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+		return nullptr;
+	return &cqes[head & cq_mask];
+}
+
+void Uring::cqe_seen()
+{
+	__atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void Uring::prep_accept_multishot(int listen_fd, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listen_fd;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->user_data = ud;
+}
+
+void Uring::prep_recv_multishot(int sock, uint16_t buf_group, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = sock;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = buf_group;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = ud;
+}
+
+void Uring::prep_sendmsg(int sock, const msghdr* msg, unsigned msg_flags, bool link, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = sock;
+	sqe->addr = (uint64_t)(uintptr_t)msg;
+	sqe->len = 1;
+	sqe->msg_flags = msg_flags;
+	if (link)
+		sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = ud;
+}
+
+void Uring::prep_read(int file, void* buf, unsigned len, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = file;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = len;
+	sqe->user_data = ud;
+}
+
+void Uring::prep_timeout(const __kernel_timespec* ts, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)(uintptr_t)ts;
+	sqe->len = 1;
+	sqe->user_data = ud;
+}
+
+void Uring::prep_cancel(uint64_t target_ud, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = target_ud;
+	sqe->user_data = ud;
+}
+
+void Uring::prep_cancel_fd(int file, uint64_t ud)
+{
+	io_uring_sqe* sqe = get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = file;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = ud;
+}
+
+bool UringBufferGroup::init(Uring& r, uint16_t bgid, unsigned count, size_t size)
+{
+	ring = &r;
+	entries = count;
+	buf_size = size;
+	group = bgid;
+	storage = (uint8_t*)std::malloc(count * size);
+	if (!storage)
+		return false;
+	io_uring_sqe* sqe = r.get_sqe();
+	if (!sqe)
+		return false;
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = (int)count;
+	sqe->addr = (uint64_t)(uintptr_t)storage;
+	sqe->len = (uint32_t)size;
+	sqe->buf_group = bgid;
+	sqe->off = 0; // first bid
+	sqe->user_data = 0;
+	bool ok = false;
+	if (r.submit(1) >= 0)
+	{
+		while (io_uring_cqe* cqe = r.peek_cqe())
+		{
+			ok = cqe->res >= 0;
+			if (!ok)
+				errno = -cqe->res;
+			r.cqe_seen();
+		}
+	}
+	return ok;
+}
+
+void UringBufferGroup::destroy()
+{
+	// the ring owning the group is torn down right after, which drops the buffers
+	std::free(storage);
+	storage = nullptr;
+}
+
+void UringBufferGroup::recycle(uint16_t bid)
+{
+	io_uring_sqe* sqe = ring->get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = 1;
+	sqe->addr = (uint64_t)(uintptr_t)buffer(bid);
+	sqe->len = (uint32_t)buf_size;
+	sqe->buf_group = group;
+	sqe->off = bid;
+	sqe->flags = IOSQE_CQE_SKIP_SUCCESS; // completion only if it fails
+	sqe->user_data = 0;
+}
+
+unsigned uring_prep_send_chain(Uring& ring, int sock, const OutputChain& out, std::vector<iovec>& iov, std::vector<msghdr>& msgs, uint64_t ud)
+{
+	iov.clear();
+	size_t skip = out.head_pos;
+	for (auto& seg : out.segments)
+	{
+		iov.push_back(iovec{ (void*)(seg.data() + skip), seg.size() - skip });
+		skip = 0;
+	}
+	size_t batches = (iov.size() + IOV_MAX - 1) / IOV_MAX;
+	msgs.assign(batches, msghdr{});
+	for (size_t b = 0; b < batches; ++b)
+	{
+		size_t first = b * IOV_MAX;
+		size_t cnt = iov.size() - first < (size_t)IOV_MAX ? iov.size() - first : (size_t)IOV_MAX;
+		msgs[b].msg_iov = &iov[first];
+		msgs[b].msg_iovlen = cnt;
+		// WAITALL makes the kernel retry short sends, so a link only breaks on real errors
+		ring.prep_sendmsg(sock, &msgs[b], MSG_NOSIGNAL | MSG_WAITALL, b + 1 < batches, ud);
+	}
+	return (unsigned)batches;
+}
+
+#endif // WASAPI_IO_URING
@@ -0,0 +1,86 @@
+#ifndef URING_H
+#define URING_H
+
+#ifdef WASAPI_IO_URING
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "iobuf.h"
+
+// user_data layout used by the reactors: operation in the high word, fd in the low word.
+inline uint64_t uring_ud(uint32_t op, int fd) { return ((uint64_t)op << 32) | (uint32_t)fd; }
+inline uint32_t uring_ud_op(uint64_t ud) { return (uint32_t)(ud >> 32); }
+inline int uring_ud_fd(uint64_t ud) { return (int)(uint32_t)ud; }
+
+// Minimal io_uring wrapper on top of the raw syscalls (no liburing dependency).
+// One ring per reactor thread, not thread-safe.
+struct Uring
+{
+	int fd = -1;
+	unsigned* sq_head = nullptr;
+	unsigned* sq_tail = nullptr;
+	unsigned sq_mask = 0;
+	unsigned sq_entries = 0;
+	io_uring_sqe* sqes = nullptr;
+	unsigned sqe_tail = 0; // local tail, published on submit()
+	unsigned* cq_head = nullptr;
+	unsigned* cq_tail = nullptr;
+	unsigned cq_mask = 0;
+	io_uring_cqe* cqes = nullptr;
+	void* sq_ptr = nullptr;
+	size_t sq_len = 0;
+	void* cq_ptr = nullptr;
+	size_t cq_len = 0;
+	size_t sqes_len = 0;
+
+	Uring() = default;
+	Uring(const Uring&) = delete;
+	Uring& operator=(const Uring&) = delete;
+	~Uring();
+
+	bool init(unsigned entries, unsigned cq_entries);
+	void destroy();
+
+	io_uring_sqe* get_sqe(); // zeroed entry; submits queued entries first if the SQ is full
+	int submit(unsigned wait_nr); // submit queued entries and wait for wait_nr completions; -errno on failure
+	io_uring_cqe* peek_cqe(); // next completion or nullptr
+	void cqe_seen(); // release the entry returned by peek_cqe()
+
+	void prep_accept_multishot(int listen_fd, uint64_t ud);
+	void prep_recv_multishot(int sock, uint16_t buf_group, uint64_t ud);
+	void prep_sendmsg(int sock, const msghdr* msg, unsigned msg_flags, bool link, uint64_t ud);
+	void prep_read(int file, void* buf, unsigned len, uint64_t ud);
+	void prep_timeout(const __kernel_timespec* ts, uint64_t ud);
+	void prep_cancel(uint64_t target_ud, uint64_t ud);
+	void prep_cancel_fd(int file, uint64_t ud); // every request on this fd
+};
+
+// Provided buffer group (IORING_OP_PROVIDE_BUFFERS) feeding buffer-select recv.
+// Buffers are handed back one at a time with CQE-less entries that ride along
+// with the next submit, so recycling costs no extra syscall.
+struct UringBufferGroup
+{
+	Uring* ring = nullptr;
+	uint8_t* storage = nullptr;
+	unsigned entries = 0;
+	size_t buf_size = 0;
+	uint16_t group = 0;
+
+	bool init(Uring& r, uint16_t bgid, unsigned count, size_t size); // call on an idle ring
+	void destroy();
+	uint8_t* buffer(uint16_t bid) { return storage + (size_t)bid * buf_size; }
+	void recycle(uint16_t bid); // hand a consumed buffer back to the kernel
+};
+
+// Queue the chain as linked MSG_WAITALL sendmsg entries, IOV_MAX segments each.
+// iov/msgs hold the descriptors and must stay untouched until every entry completes.
+// Returns the number of entries queued.
+unsigned uring_prep_send_chain(Uring& ring, int sock, const OutputChain& out, std::vector<iovec>& iov, std::vector<msghdr>& msgs, uint64_t ud);
+
+#endif // WASAPI_IO_URING
+
+#endif // URING_H
@@ -17,7 +17,6 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <sstream>
 #include <thread>
 #include "fastcgi.h"
 #include "http.h"
@@ -26,65 +25,65 @@
 #include "memory.h"
 #include "session.h"
 #include "request.h"
+#include "response.h"
 #include <functional>
 
 #include "fcgi-connection.h"
 #include "websockets.h"
 #include "worker.h"
+#include "fileops.h"
+#include "affinity.h"
 
-static void on_request_ready(Request& r, std::vector<uint8_t>& out_buf)
+static void on_request_ready(Request& r, ResponseWriter& out)
 {
 	if (r.flags & Request::RESPONDED)
 		return; // already handled
 
-	std::ostringstream oss;
-	output_headers(r, oss);
+	output_headers(r, out);
 
-	r.env["DBG_ARENA_ALLOC"] = DynamicVariable::make_number(r.arena->offset);
-	oss << "-- ENV --\n";
-	print_any_limited(oss, r.env, global_config.print_env_limit, global_config.print_indent);
+	r.env["DBG_ARENA_ALLOC"] = DynamicVariable::make_number(r.arena->used());
+	out << "-- ENV --\n";
+	print_any_limited(out, r.env, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "-- CONTEXT --\n";
-	print_any_limited(oss, r.context, global_config.print_env_limit, global_config.print_indent);
+	out << "-- CONTEXT --\n";
+	print_any_limited(out, r.context, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "-- COOKIES --\n";
-	print_any_limited(oss, r.cookies, global_config.print_env_limit, global_config.print_indent);
+	out << "-- COOKIES --\n";
+	print_any_limited(out, r.cookies, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "-- PARAMS --\n";
-	print_any_limited(oss, r.params, global_config.print_env_limit, global_config.print_indent);
+	out << "-- PARAMS --\n";
+	print_any_limited(out, r.params, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "-- HEADERS(OUT) --\n";
-	print_any_limited(oss, r.headers, global_config.print_env_limit, global_config.print_indent);
+	out << "-- HEADERS(OUT) --\n";
+	print_any_limited(out, r.headers, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "-- FILES --\n";
-	print_any_limited(oss, r.files, global_config.print_env_limit, global_config.print_indent);
+	out << "-- FILES --\n";
+	print_any_limited(out, r.files, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "-- SESSION --\n";
-	print_any_limited(oss, r.session, global_config.print_env_limit, global_config.print_indent);
+	out << "-- SESSION --\n";
+	print_any_limited(out, r.session, global_config.print_env_limit, global_config.print_indent);
 
-	oss << "\n-- BODY (" << r.body_bytes << " bytes) --\n";
+	out << "\n-- BODY (" << r.body_bytes << " bytes) --\n";
 	size_t preview_cap = global_config.body_preview_limit ? global_config.body_preview_limit : 1024;
-	size_t show = r.body.size() < preview_cap ? r.body.size() : preview_cap;
+	std::string_view head = r.body.memory(); // no need to touch a spilled body for a preview
+	size_t show = head.size() < preview_cap ? head.size() : preview_cap;
 	for (size_t i = 0; i < show; i++)
 	{
-		uint8_t b = r.body[i];
+		uint8_t b = head[i];
 		if (b >= 32 && b < 127)
-			oss << char(b);
+			out << char(b);
 		else if (b == '\n' || b == '\r' || b == '\t')
-			oss << char(b);
+			out << char(b);
 		else
-			oss << '.';
+			out << '.';
 	}
 	if (show < r.body.size())
-		oss << "\n[truncated]";
-
-	fcgi::append_stdout_text(out_buf, r.id, oss.str());
+		out << "\n[truncated]";
 
 	if (!r.session_id.empty())
 		session_save(r);
 
-	fcgi::append_end_request(out_buf, r.id, 0, fcgi::REQUEST_COMPLETE);
-	r.flags |= Request::RESPONDED;
+	out.finish(0);
 }
 
 static void handle_signal(int)
@@ -98,6 +97,16 @@ static void usage(const char* prog)
 						 "Options:\n"
 						 "  --fcgi-port N                TCP port (default 9000)\n"
 						 "  --fcgi-socket PATH           alt. UNIX socket path for FastCGI\n"
+						 "  --fcgi-reactors N            FastCGI IO threads (default 1, 0 = one per core)\n"
+						 "  --io-backend epoll|uring     reactor backend (default epoll)\n"
+						 "  --max-in-flight N            requests held at once (default 8)\n"
+						 "  --worker-threads N           handler threads (default 0 = one per core)\n"
+						 "  --blocking-threads N         threads for disk-bound request stages (default 4)\n"
+						 "  --reactor-cpus LIST          pin IO threads, e.g. 0-3,8 (one CPU each, round robin)\n"
+						 "  --worker-cpus LIST           pin handler threads the same way\n"
+						 "  --no-numa                    keep arenas off NUMA node binding\n"
+						 "  --arena-watermark BYTES      committed memory a free arena keeps (default 65536)\n"
+						 "  --arena-hugepages            back the arenas with transparent huge pages\n"
 						 "  --ws-port N                  WebSocket port (default 9001)\n"
 						 "  --ws-socket PATH             alt. UNIX socket path for WebSocket\n",
 				 prog);
@@ -134,8 +143,19 @@ int main(int argc, char* argv[])
 
 	setup_signal_handlers();
 
-	global_arena_manager.create_arenas(global_config.max_in_flight, global_config.arena_capacity);
-	global_worker_pool.start(global_config.max_in_flight);
+	global_block_pool.configure(global_config.arena_block_size, global_config.arena_blocks_cached);
+	size_t arena_count[ARENA_CLASSES];
+	arena_count[ARENA_SMALL] = global_config.max_in_flight / 2;
+	arena_count[ARENA_MEDIUM] = global_config.max_in_flight / 4;
+	arena_count[ARENA_LARGE] = global_config.max_in_flight - arena_count[ARENA_SMALL] - arena_count[ARENA_MEDIUM];
+	size_t arena_capacity[ARENA_CLASSES] = { global_config.arena_small_capacity, global_config.arena_medium_capacity, global_config.arena_capacity };
+	global_arena_manager.watermark = global_config.arena_watermark;
+	global_arena_manager.hugepages = global_config.arena_hugepages;
+	global_arena_manager.create_arenas(arena_count, arena_capacity, global_config.numa_arenas);
+	size_t workers = global_config.worker_threads ? global_config.worker_threads : std::thread::hardware_concurrency();
+	global_worker_pool.start(workers ? workers : 1, global_config.worker_cpus);
+	global_blocking_pool.start(global_config.blocking_threads);
+	global_file_executor.start(global_config.file_threads);
 
 	register_thread_name("main");
 	std::thread fcgi_thread([]()
@@ -145,6 +165,8 @@ int main(int argc, char* argv[])
 	std::thread ws_thread([]()
 						  {
 		register_thread_name("ws");
+		size_t fcgi_reactors = global_config.fcgi_reactors ? global_config.fcgi_reactors : std::thread::hardware_concurrency();
+		pin_thread(global_config.reactor_cpus, fcgi_reactors); // the CPU after the FastCGI reactors'
 		ws::serve(global_config.ws_port, global_config.ws_socket_path, on_request_ready, on_request_ready); });
 
 	fcgi_thread.join();
@@ -1,6 +1,7 @@
 #include "websockets.h"
 #include "config.h"
 #include "memory.h"
+#include "affinity.h"
 #include "logger.h"
 #include "dynamic_variable.h"
 #include "worker.h"
@@ -22,7 +23,10 @@
 #include <algorithm>
 #include <sys/types.h>
 #include <sys/eventfd.h>
-#include <mutex>
+#include "iobuf.h"
+#include "uring.h"
+#include "timer_wheel.h"
+#include "mpsc_queue.h"
 
 namespace ws
 {
@@ -47,22 +51,47 @@ namespace ws
 		std::unordered_map<std::string, std::string> http_headers; // lowercase keys
 		bool close_after_write = false; // for plain HTTP response
 		std::vector<uint8_t> in_buf;
-		std::vector<uint8_t> out_buf; // guarded by IO thread only; workers queue via pending list
+		OutputChain out; // guarded by IO thread only; workers queue via pending list
 		std::atomic<bool> closed{ false };
 		bool assembling = false;
 		uint8_t assemble_opcode = 0; // original opcode (text/binary)
 		std::vector<uint8_t> assemble_data;
+		TimerNode ping_timer; // keepalive ping / pong deadline
+		uint64_t last_input_ms = 0;
+		bool awaiting_pong = false;
+#ifdef WASAPI_IO_URING
+		// io_uring loop only
+		unsigned ops_inflight = 0; // armed recv + queued sends
+		unsigned sends_inflight = 0;
+		bool recv_armed = false;
+		bool closing = false; // fd closed once ops_inflight drops to 0
+		std::vector<iovec> send_iov;
+		std::vector<msghdr> send_msgs;
+#endif
 	};
 
 	struct PendingFrame
 	{
 		int fd;
 		std::vector<uint8_t> frame; // already encoded websocket frame
+		PendingFrame* next = nullptr; // MpscQueue link
 	};
 
 	static int g_eventfd = -1; // notify IO thread of pending frames
-	static std::mutex g_pending_mutex;
-	static std::vector<PendingFrame> g_pending_frames;
+	static MpscQueue<PendingFrame> g_pending_frames;
+
+	// Worker side: hand a frame to the IO thread, waking it only if it had nothing queued.
+	static void queue_frame(int fd, std::vector<uint8_t>&& frame)
+	{
+		if (g_pending_frames.push(new PendingFrame{ fd, std::move(frame) }) && g_eventfd != -1)
+		{
+			uint64_t v = 1;
+			ssize_t wr = write(g_eventfd, &v, sizeof(v));
+			(void)wr;
+		}
+	}
+
+	static const uint32_t WS_TIMER_TICK_MS = 250;
 
 	static int set_non_block(int fd)
 	{
@@ -97,21 +126,15 @@ namespace ws
 		return fd;
 	}
 
-	static void send_all(int fd, std::vector<uint8_t>& buf)
+	// Send what the socket takes and keep EPOLLOUT armed while anything is left.
+	static void flush_client(int epfd, Client& c)
 	{
-		while (!buf.empty())
-		{
-			ssize_t n = ::send(fd, buf.data(), buf.size(), 0);
-			if (n > 0)
-				buf.erase(buf.begin(), buf.begin() + n);
-			else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
-				return;
-			else
-			{
-				buf.clear();
-				return;
-			}
-		}
+		if (c.out.flush(c.fd) < 0)
+			c.out.clear();
+		epoll_event mod{};
+		mod.data.fd = c.fd;
+		mod.events = c.out.empty() ? (EPOLLIN | EPOLLET) : (EPOLLIN | EPOLLOUT | EPOLLET);
+		epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &mod);
 	}
 
 	static std::vector<uint8_t> build_ws_frame(uint8_t opcode, const uint8_t* payload, size_t len)
@@ -140,44 +163,84 @@ namespace ws
 		return out;
 	}
 
+	static void start_ping_timer(TimerWheel& timers, Client& c, uint64_t now)
+	{
+		c.last_input_ms = now;
+		if (global_config.ws_ping_interval <= 0)
+			return;
+		c.ping_timer.owner = &c;
+		timers.schedule(c.ping_timer, now + (uint64_t)(global_config.ws_ping_interval * 1000));
+	}
+
+	// Any input proves the peer alive; the timer notices lazily via last_input_ms.
+	static void note_input(Client& c, uint64_t now)
+	{
+		c.last_input_ms = now;
+		c.awaiting_pong = false;
+	}
+
+	// Ping an upgraded client once it has been silent for ws_ping_interval, close it
+	// if the pong does not arrive within ws_ping_timeout. Returns false to close.
+	static bool on_ping_timer(TimerWheel& timers, Client& c, uint64_t now)
+	{
+		if (c.awaiting_pong)
+		{
+			log_debug("websocket fd=%d missed pong, closing", c.fd);
+			c.closed.store(true);
+			return false;
+		}
+		uint64_t interval = (uint64_t)(global_config.ws_ping_interval * 1000);
+		uint64_t due = c.last_input_ms + interval;
+		if (due > now || !c.handshake_done || c.http_mode)
+		{
+			timers.schedule(c.ping_timer, due > now ? due : now + interval);
+			return true;
+		}
+		c.out.append(build_ws_frame(0x9, nullptr, 0));
+		c.awaiting_pong = true;
+		timers.schedule(c.ping_timer, now + (uint64_t)(global_config.ws_ping_timeout * 1000));
+		return true;
+	}
+
 	static void schedule_message(RequestReadyCallback cb, Client& c, uint8_t opcode, std::vector<uint8_t>&& data)
 	{
-		Arena* a = global_arena_manager.get();
+		Arena* a = global_arena_manager.get(current_numa_node(), global_arena_manager.class_for(sizeof(Request) + data.size()));
 		if (!a)
 			return; // backpressure: drop if no arena
-		void* mem = a->alloc(sizeof(Request), alignof(Request));
-		if (!mem)
+		Request* r = Request::acquire(a);
+		if (!r)
 		{
 			global_arena_manager.release(a);
 			return;
 		}
-		Request* r = new (mem) Request(a);
 		r->id = 0;
-		r->body.assign(reinterpret_cast<const char*>(data.data()), data.size()); // binary safe
+		r->body.assign(std::string_view(reinterpret_cast<const char*>(data.data()), data.size())); // binary safe
 		r->body_bytes = data.size();
 		r->env["WS"] = DynamicVariable::make_string("1");
 		r->env["MESSAGE_TYPE"] = DynamicVariable::make_string(opcode == 0x2 ? "binary" : "text");
 		r->env["OPCODE"] = DynamicVariable::make_string(std::to_string(opcode));
 		r->env["CLIENT_FD"] = DynamicVariable::make_string(std::to_string(c.fd));
 		r->flags |= Request::INITIALIZED | Request::PARAMS_COMPLETE | Request::INPUT_COMPLETE;
-		::global_worker_pool.enqueue([cb, r, a, fd = c.fd, opcode]()
-									 {
+		r->work.task_class = TASK_MESSAGE;
+		r->work.tenant = (uint32_t)c.fd; // one chatty client only delays itself
+		r->work.fn = [cb, r, a, fd = c.fd, opcode]()
+		{
 		std::vector<uint8_t> resp;
-		if (cb) cb(*r, resp);
+		if (cb)
+		{
+			ResponseWriter out(*r, resp);
+			cb(*r, out);
+			out.finish();
+		}
 		std::vector<uint8_t> frame;
 		if (!resp.empty())
 			frame = build_ws_frame(opcode, resp.data(), resp.size());
 		if (!frame.empty())
-		{
-			std::lock_guard<std::mutex> lk(g_pending_mutex);
-			g_pending_frames.push_back(PendingFrame{fd, std::move(frame)});
-			if (g_eventfd != -1)
-			{
-				uint64_t v=1; ssize_t wr = write(g_eventfd, &v, sizeof(v)); (void)wr;
-			}
-		}
-		r->~Request();
-		if (a) global_arena_manager.release(a); });
+			queue_frame(fd, std::move(frame));
+		Request::retire(r);
+		if (a) global_arena_manager.release(a);
+		};
+		::global_worker_pool.enqueue(r->work);
 	}
 
 	static bool parse_http_headers(const std::string& http, std::string& key, std::string& response_key)
@@ -228,11 +291,10 @@ namespace ws
 	{
 		if (!cbhttp) return;
 		// Build Request analogous to FastCGI-populated request
-		Arena* a = global_arena_manager.get();
+		Arena* a = global_arena_manager.get(current_numa_node(), global_arena_manager.class_for(sizeof(Request) + body.size()));
 		if (!a) return;
-		void* mem = a->alloc(sizeof(Request), alignof(Request));
-		if (!mem) { global_arena_manager.release(a); return; }
-		Request* r = new (mem) Request(a);
+		Request* r = Request::acquire(a);
+		if (!r) { global_arena_manager.release(a); return; }
 		r->flags |= Request::INITIALIZED;
 		// Parse request line
 		size_t line_end = request_text.find("\r\n");
@@ -289,22 +351,26 @@ namespace ws
 		if (auto it = headers.find("Content-Type"); it != headers.end()) r->env["CONTENT_TYPE"] = DynamicVariable::make_string(it->second);
 		if (auto it = headers.find("Content-Length"); it != headers.end()) r->env["CONTENT_LENGTH"] = DynamicVariable::make_string(it->second);
 		// Body
-		r->body = std::move(body);
+		r->body.assign(body);
 		r->body_bytes = r->body.size();
 		r->flags |= Request::PARAMS_COMPLETE | Request::INPUT_COMPLETE; // no streaming for now
-		// Parse query string into params
-		parse_query_string(*r, r->env.find("QUERY_STRING"));
-		// Cookies
-		parse_cookie_header(*r, r->env.find("HTTP_COOKIE"));
-		// Form data (json/multipart/urlencoded)
-		parse_form_data(*r);
 		// Tag origin
 		r->env["WS"] = DynamicVariable::make_string("0");
 		r->env["CLIENT_FD"] = DynamicVariable::make_string(std::to_string(c.fd));
-		::global_worker_pool.enqueue([cbhttp, r, a, fd = c.fd]() {
+		r->work.task_class = TASK_HTTP;
+		r->work.tenant = request_tenant(*r);
+		r->work.fn = [cbhttp, r, a, fd = c.fd]() {
+			// Parsing may write upload files, so it stays off the IO thread
+			parse_query_string(*r, r->env.find("QUERY_STRING"));
+			parse_cookie_header(*r, r->env.find("HTTP_COOKIE"));
+			parse_form_data(*r); // json/multipart/urlencoded
 			// Worker builds FastCGI-style output into resp_fcgi; we adapt to HTTP
 			std::vector<uint8_t> resp_fcgi;
-			cbhttp(*r, resp_fcgi);
+			{
+				ResponseWriter out(*r, resp_fcgi);
+				cbhttp(*r, out);
+				out.finish();
+			}
 			// Decode FCGI_STDOUT records to aggregate payload
 			std::string body;
 			const uint8_t* p = resp_fcgi.data();
@@ -331,39 +397,206 @@ namespace ws
 				if (hct && hct->type == DynamicVariable::STRING) ct = hct->data.s;
 				payload = "HTTP/1.1 200 OK\r\nContent-Type: " + ct + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
 			}
-			std::vector<uint8_t> frame(payload.begin(), payload.end());
-			{
-				std::lock_guard<std::mutex> lk(g_pending_mutex);
-				g_pending_frames.push_back(PendingFrame{fd, std::move(frame)});
-				if (g_eventfd != -1) { uint64_t v=1; ssize_t wr = write(g_eventfd, &v, sizeof(v)); (void)wr; }
-			}
-			r->~Request();
+			queue_frame(fd, std::vector<uint8_t>(payload.begin(), payload.end()));
+			Request::retire(r);
 			if (a) global_arena_manager.release(a);
-		});
+		};
+		// uploads are written out and waited for while parsing: blocking-pool work
+		bool blocking = form_data_touches_disk(*r) && ::global_blocking_pool.size();
+		(blocking ? ::global_blocking_pool : ::global_worker_pool).enqueue(r->work);
 	}
 
-	int serve(int port, const std::string& unix_socket, RequestReadyCallback cbws, RequestReadyCallback cbhttp)
+	// Handshake / plain HTTP / frame parsing over everything buffered in c.in_buf.
+	static void handle_input(Client& c, RequestReadyCallback cbws, RequestReadyCallback cbhttp)
 	{
-		int listen_fd = -1;
-		if (!unix_socket.empty())
-			listen_fd = create_unix_listen_socket(unix_socket);
-		else
-			listen_fd = create_listen_socket(port);
-		if (listen_fd == -1)
+		if (!c.handshake_done)
 		{
-			log_error("websocket listen failed");
-			return 1;
+			c.in_http.append((char*)c.in_buf.data(), c.in_buf.size());
+			c.in_buf.clear();
+			size_t hdr_end = c.in_http.find("\r\n\r\n");
+			if (hdr_end != std::string::npos)
+			{
+				std::string key, accept_key;
+				bool is_upgrade = false;
+				if (parse_http_headers(c.in_http.substr(0, hdr_end + 4), key, accept_key))
+				{
+					std::string response =
+						"HTTP/1.1 101 Switching Protocols\r\n"
+						"Upgrade: websocket\r\n"
+						"Connection: Upgrade\r\n"
+						"Sec-WebSocket-Accept: " +
+						accept_key + "\r\n\r\n";
+					c.out.append(std::vector<uint8_t>(response.begin(), response.end()));
+					c.handshake_done = true;
+					is_upgrade = true;
+				}
+				if (!is_upgrade)
+				{
+					// Parse headers to find Content-Length
+					c.http_mode = true;
+					std::string headers_part = c.in_http.substr(0, hdr_end + 4);
+					size_t line_end = headers_part.find("\r\n");
+					if (line_end == std::string::npos) { c.closed.store(true); return; }
+					// Find content-length manually
+					size_t hpos = 0;
+					while (true) {
+						size_t lend = headers_part.find("\r\n", hpos);
+						if (lend == std::string::npos || lend == hpos) break;
+						std::string line = headers_part.substr(hpos, lend - hpos);
+						hpos = lend + 2;
+						size_t colon = line.find(':');
+						if (colon != std::string::npos) {
+							std::string name = line.substr(0, colon);
+							for (auto &ch: name) ch = std::tolower((unsigned char)ch);
+							if (name == "content-length") {
+								std::string val = line.substr(colon+1); trim_spaces(val); c.http_content_length = (size_t)std::strtoull(val.c_str(), nullptr, 10); break; }
+						}
+					}
+					c.http_headers_parsed = true;
+					// Move any body bytes already read (after headers) into in_buf
+					size_t already = c.in_http.size() - (hdr_end + 4);
+					if (already) {
+						std::string tail = c.in_http.substr(hdr_end + 4);
+						c.in_buf.insert(c.in_buf.end(), tail.begin(), tail.end());
+					}
+					// If full body present (or none expected) schedule immediately
+					if (c.in_buf.size() >= c.http_content_length) {
+						std::string body;
+						if (c.http_content_length) body.assign((char*)c.in_buf.data(), c.http_content_length);
+						schedule_http(cbhttp, c, std::move(c.in_http), std::move(body));
+						c.in_buf.clear();
+						c.in_http.clear(); // schedule_http only reads it; a later read must not dispatch again
+						// close deferred via close_after_write
+					}
+				}
+			}
+			else if (c.http_mode && c.http_headers_parsed)
+			{
+				// Accumulate until content-length reached
+				if (c.in_buf.size() >= c.http_content_length)
+				{
+					std::string body;
+					if (c.http_content_length)
+						body.assign((char*)c.in_buf.data(), c.http_content_length);
+					schedule_http(cbhttp, c, std::move(c.in_http), std::move(body));
+					c.in_buf.clear();
+					c.in_http.clear();
+					// close deferred via close_after_write
+				}
+			}
 		}
+		if (c.handshake_done)
 		{
-			std::string addr = unix_socket.empty() ? (std::string("tcp:") + std::to_string(port)) : unix_socket;
-			log_info("Websocket server listening on %s", addr.c_str());
+			while (true)
+			{
+				if (c.in_buf.size() < 2)
+					break;
+				uint8_t b0 = c.in_buf[0];
+				uint8_t b1 = c.in_buf[1];
+				bool fin = (b0 & 0x80) != 0;
+				uint8_t opcode = b0 & 0x0F;
+				bool masked = (b1 & 0x80) != 0;
+				size_t payload_len = b1 & 0x7F;
+				size_t header_len = 2;
+				if (payload_len == 126)
+				{
+					if (c.in_buf.size() < 4)
+						break;
+					payload_len = (c.in_buf[2] << 8) | c.in_buf[3];
+					header_len = 4;
+				}
+				else if (payload_len == 127)
+				{
+					if (c.in_buf.size() < 10)
+						break;
+					payload_len = 0;
+					for (int k = 0; k < 8; ++k)
+						payload_len = (payload_len << 8) | c.in_buf[2 + k];
+					header_len = 10;
+				}
+				size_t mask_len = masked ? 4 : 0;
+				if (c.in_buf.size() < header_len + mask_len + payload_len)
+					break;
+				const uint8_t* mask = masked ? &c.in_buf[header_len] : nullptr;
+				const uint8_t* data = &c.in_buf[header_len + mask_len];
+				std::vector<uint8_t> payload;
+				payload.assign(data, data + payload_len);
+				if (masked)
+					for (size_t k = 0; k < payload_len; ++k)
+						payload[k] ^= mask[k % 4];
+				if (opcode == 0x8) // close
+				{
+					c.closed.store(true);
+				}
+				else if (opcode == 0x9) // ping
+				{
+					std::vector<uint8_t> pong = build_ws_frame(0xA, payload.data(), payload.size());
+					c.out.append(std::move(pong));
+				}
+				else if (opcode == 0xA)
+				{
+				}
+				else if (opcode == 0x1 || opcode == 0x2)
+				{
+					if (c.assembling)
+					{
+						c.assemble_data.clear();
+						c.assembling = false;
+					}
+					if (fin)
+					{
+						schedule_message(cbws, c, opcode, std::move(payload));
+					}
+					else
+					{
+						c.assembling = true;
+						c.assemble_opcode = opcode;
+						c.assemble_data = std::move(payload);
+					}
+				}
+				else if (opcode == 0x0) // continuation
+				{
+					if (!c.assembling)
+					{
+						c.closed.store(true);
+					}
+					else
+					{
+						c.assemble_data.insert(c.assemble_data.end(), payload.begin(), payload.end());
+						if (fin)
+						{
+							uint8_t final_opcode = c.assemble_opcode;
+							std::vector<uint8_t> complete;
+							complete.swap(c.assemble_data);
+							c.assembling = false;
+							schedule_message(cbws, c, final_opcode, std::move(complete));
+						}
+					}
+				}
+				c.in_buf.erase(c.in_buf.begin(), c.in_buf.begin() + header_len + mask_len + payload_len);
+			}
 		}
+	}
+
+	// IO side: hand every queued frame to deliver(), oldest first.
+	template <typename F>
+	static void drain_pending_frames(F&& deliver)
+	{
+		PendingFrame* pf = g_pending_frames.take_all();
+		while (pf)
+		{
+			PendingFrame* next = pf->next;
+			deliver(*pf);
+			delete pf;
+			pf = next;
+		}
+	}
+
+	static int serve_epoll(int listen_fd, RequestReadyCallback cbws, RequestReadyCallback cbhttp)
+	{
 		int epfd = epoll_create1(0);
 		if (epfd == -1)
-		{
-			::close(listen_fd);
 			return 1;
-		}
 		epoll_event lev{};
 		lev.data.fd = listen_fd;
 		lev.events = EPOLLIN | EPOLLET;
@@ -377,17 +610,31 @@ namespace ws
 			epoll_ctl(epfd, EPOLL_CTL_ADD, g_eventfd, &eev);
 		}
 		std::unordered_map<int, Client> clients;
+		TimerWheel timers(WS_TIMER_TICK_MS);
 		const int MAX_EVENTS = 64;
 		std::vector<epoll_event> events(MAX_EVENTS);
 		while (true)
 		{
-			int n = epoll_wait(epfd, events.data(), MAX_EVENTS, 1000);
+			uint64_t wait_ms = timers.next_timeout_ms(monotonic_ms());
+			int n = epoll_wait(epfd, events.data(), MAX_EVENTS, wait_ms < 1000 ? (int)wait_ms : 1000);
 			if (n == -1)
 			{
 				if (errno == EINTR)
 					continue;
 				break;
 			}
+			uint64_t now = monotonic_ms();
+			timers.advance(now, [&](TimerNode& t)
+						   {
+				Client& c = *static_cast<Client*>(t.owner);
+				if (on_ping_timer(timers, c, now))
+				{
+					flush_client(epfd, c);
+					return;
+				}
+				epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+				::close(c.fd);
+				clients.erase(c.fd); });
 			for (int i = 0; i < n; ++i)
 			{
 				int fd = events[i].data.fd;
@@ -411,7 +658,9 @@ namespace ws
 						cev.data.fd = cfd;
 						cev.events = EPOLLIN | EPOLLET;
 						epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
-						clients[cfd].fd = cfd;
+						Client& c = clients[cfd];
+						c.fd = cfd;
+						start_ping_timer(timers, c, now);
 					}
 					continue;
 				}
@@ -421,23 +670,14 @@ namespace ws
 					while (::read(g_eventfd, &val, sizeof(val)) > 0)
 					{
 					}
-					std::vector<PendingFrame> local;
-					{
-						std::lock_guard<std::mutex> lk(g_pending_mutex);
-						local.swap(g_pending_frames);
-					}
-					for (auto& pf : local)
-					{
+					drain_pending_frames([&](PendingFrame& pf)
+										 {
 						auto itc = clients.find(pf.fd);
 						if (itc == clients.end())
-							continue;
+							return;
 						Client& cc = itc->second;
-						cc.out_buf.insert(cc.out_buf.end(), pf.frame.begin(), pf.frame.end());
-						epoll_event mod{};
-						mod.data.fd = cc.fd;
-						mod.events = EPOLLIN | EPOLLOUT | EPOLLET;
-						epoll_ctl(epfd, EPOLL_CTL_MOD, cc.fd, &mod);
-					}
+						cc.out.append(std::move(pf.frame));
+						flush_client(epfd, cc); });
 					continue;
 				}
 				auto it = clients.find(fd);
@@ -455,7 +695,10 @@ namespace ws
 						uint8_t buf[4096];
 						ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
 						if (r > 0)
+						{
 							c.in_buf.insert(c.in_buf.end(), buf, buf + r);
+							note_input(c, now);
+						}
 						else if (r == 0)
 						{
 							c.closed.store(true);
@@ -469,207 +712,248 @@ namespace ws
 							break;
 						}
 					}
-					if (!c.handshake_done)
+					handle_input(c, cbws, cbhttp);
+				}
+				flush_client(epfd, c);
+				if (c.closed.load() || (c.close_after_write && c.out.empty()))
+				{
+					timers.cancel(c.ping_timer);
+					epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+					::close(fd);
+					clients.erase(it);
+				}
+			}
+		}
+		if (g_eventfd != -1)
+		{
+			::close(g_eventfd);
+			g_eventfd = -1;
+		}
+		::close(epfd);
+		return 0;
+	}
+
+#ifdef WASAPI_IO_URING
+	enum UringOp : uint32_t
+	{
+		URING_ACCEPT = 1,
+		URING_RECV,
+		URING_SEND,
+		URING_EVENT,
+		URING_TIMER,
+		URING_CANCEL,
+		URING_TICK
+	};
+	static const unsigned URING_ENTRIES = 512;
+	static const unsigned URING_RECV_BUFFERS = 128; // power of two
+	static const size_t URING_RECV_BUFFER_SIZE = 16 * 1024;
+	static const uint16_t URING_RECV_GROUP = 0;
+
+	static void uring_arm_recv(Uring& ring, Client& c)
+	{
+		if (c.recv_armed || c.closing || c.closed.load())
+			return;
+		ring.prep_recv_multishot(c.fd, URING_RECV_GROUP, uring_ud(URING_RECV, c.fd));
+		c.recv_armed = true;
+		++c.ops_inflight;
+	}
+
+	static void uring_send(Uring& ring, Client& c)
+	{
+		if (c.sends_inflight || c.closing || c.out.empty())
+			return;
+		unsigned n = uring_prep_send_chain(ring, c.fd, c.out, c.send_iov, c.send_msgs, uring_ud(URING_SEND, c.fd));
+		c.sends_inflight += n;
+		c.ops_inflight += n;
+	}
+
+	// Returns true once the fd is closed and the client may be erased; until then
+	// the kernel still holds operations (and buffers) referring to it.
+	static bool uring_close(Uring& ring, Client& c)
+	{
+		if (!c.closing)
+		{
+			c.closing = true;
+			if (c.ops_inflight)
+			{
+				ring.prep_cancel_fd(c.fd, uring_ud(URING_CANCEL, c.fd));
+				::shutdown(c.fd, SHUT_RDWR);
+			}
+		}
+		if (c.ops_inflight)
+			return false;
+		::close(c.fd);
+		return true;
+	}
+
+	// Completion-driven variant of serve_epoll(). Returns false if no ring could be set up.
+	static bool serve_uring(int listen_fd, RequestReadyCallback cbws, RequestReadyCallback cbhttp)
+	{
+		Uring ring;
+		UringBufferGroup bufs;
+		if (!ring.init(URING_ENTRIES, URING_ENTRIES * 4) || !bufs.init(ring, URING_RECV_GROUP, URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE))
+		{
+			log_error("io_uring unavailable (%s), websocket server uses epoll", std::strerror(errno));
+			return false;
+		}
+		std::unordered_map<int, Client> clients;
+		uint64_t event_value = 0;
+		__kernel_timespec accept_retry{ 0, 100 * 1000 * 1000 };
+		__kernel_timespec tick{ 0, WS_TIMER_TICK_MS * 1000 * 1000 };
+		TimerWheel timers(WS_TIMER_TICK_MS);
+		g_eventfd = eventfd(0, EFD_CLOEXEC);
+		if (g_eventfd != -1)
+			ring.prep_read(g_eventfd, &event_value, sizeof(event_value), uring_ud(URING_EVENT, g_eventfd));
+		ring.prep_accept_multishot(listen_fd, uring_ud(URING_ACCEPT, listen_fd));
+		if (global_config.ws_ping_interval > 0)
+			ring.prep_timeout(&tick, uring_ud(URING_TICK, -1));
+		while (true)
+		{
+			int ret = ring.submit(1);
+			if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY)
+			{
+				log_error("io_uring_enter: %s", std::strerror(-ret));
+				break;
+			}
+			while (io_uring_cqe* cqe = ring.peek_cqe())
+			{
+				uint64_t ud = cqe->user_data;
+				int res = cqe->res;
+				uint32_t flags = cqe->flags;
+				ring.cqe_seen();
+				uint32_t op = uring_ud_op(ud);
+				int fd = uring_ud_fd(ud);
+				if (op == URING_ACCEPT)
+				{
+					if (res >= 0)
 					{
-						c.in_http.append((char*)c.in_buf.data(), c.in_buf.size());
-						c.in_buf.clear();
-						size_t hdr_end = c.in_http.find("\r\n\r\n");
-						if (hdr_end != std::string::npos)
-						{
-							std::string key, accept_key;
-							bool is_upgrade = false;
-							if (parse_http_headers(c.in_http.substr(0, hdr_end + 4), key, accept_key))
-							{
-								std::string response =
-									"HTTP/1.1 101 Switching Protocols\r\n"
-									"Upgrade: websocket\r\n"
-									"Connection: Upgrade\r\n"
-									"Sec-WebSocket-Accept: " +
-									accept_key + "\r\n\r\n";
-								c.out_buf.insert(c.out_buf.end(), response.begin(), response.end());
-								c.handshake_done = true;
-								is_upgrade = true;
-							}
-							if (!is_upgrade)
-							{
-								// Parse headers to find Content-Length
-								c.http_mode = true;
-								std::string headers_part = c.in_http.substr(0, hdr_end + 4);
-								size_t line_end = headers_part.find("\r\n");
-								if (line_end == std::string::npos) { c.closed.store(true); continue; }
-								// Find content-length manually
-								size_t hpos = 0;
-								while (true) {
-									size_t lend = headers_part.find("\r\n", hpos);
-									if (lend == std::string::npos || lend == hpos) break;
-									std::string line = headers_part.substr(hpos, lend - hpos);
-									hpos = lend + 2;
-									size_t colon = line.find(':');
-									if (colon != std::string::npos) {
-										std::string name = line.substr(0, colon);
-										for (auto &ch: name) ch = std::tolower((unsigned char)ch);
-										if (name == "content-length") {
-											std::string val = line.substr(colon+1); trim_spaces(val); c.http_content_length = (size_t)std::strtoull(val.c_str(), nullptr, 10); break; }
-									}
-								}
-								c.http_headers_parsed = true;
-								// Move any body bytes already read (after headers) into in_buf
-								size_t already = c.in_http.size() - (hdr_end + 4);
-								if (already) {
-									std::string tail = c.in_http.substr(hdr_end + 4);
-									c.in_buf.insert(c.in_buf.end(), tail.begin(), tail.end());
-								}
-								// If full body present (or none expected) schedule immediately
-								if (c.in_buf.size() >= c.http_content_length) {
-									std::string body;
-									if (c.http_content_length) body.assign((char*)c.in_buf.data(), c.http_content_length);
-									schedule_http(cbhttp, c, std::move(c.in_http), std::move(body));
-									c.in_buf.clear();
-									// close deferred via close_after_write
-								}
-							}
-						}
-						else if (c.http_mode && c.http_headers_parsed)
-						{
-							// Accumulate until content-length reached
-							if (c.in_buf.size() >= c.http_content_length)
-							{
-								std::string body;
-								if (c.http_content_length)
-									body.assign((char*)c.in_buf.data(), c.http_content_length);
-								schedule_http(cbhttp, c, std::move(c.in_http), std::move(body));
-								c.in_buf.clear();
-								// close deferred via close_after_write
-							}
-						}
+						Client& c = clients[res];
+						c.fd = res;
+						start_ping_timer(timers, c, monotonic_ms());
+						uring_arm_recv(ring, c);
 					}
-					if (c.handshake_done)
+					if (!(flags & IORING_CQE_F_MORE))
 					{
-						while (true)
-						{
-							if (c.in_buf.size() < 2)
-								break;
-							uint8_t b0 = c.in_buf[0];
-							uint8_t b1 = c.in_buf[1];
-							bool fin = (b0 & 0x80) != 0;
-							uint8_t opcode = b0 & 0x0F;
-							bool masked = (b1 & 0x80) != 0;
-							size_t payload_len = b1 & 0x7F;
-							size_t header_len = 2;
-							if (payload_len == 126)
-							{
-								if (c.in_buf.size() < 4)
-									break;
-								payload_len = (c.in_buf[2] << 8) | c.in_buf[3];
-								header_len = 4;
-							}
-							else if (payload_len == 127)
-							{
-								if (c.in_buf.size() < 10)
-									break;
-								payload_len = 0;
-								for (int k = 0; k < 8; ++k)
-									payload_len = (payload_len << 8) | c.in_buf[2 + k];
-								header_len = 10;
-							}
-							size_t mask_len = masked ? 4 : 0;
-							if (c.in_buf.size() < header_len + mask_len + payload_len)
-								break;
-							const uint8_t* mask = masked ? &c.in_buf[header_len] : nullptr;
-							const uint8_t* data = &c.in_buf[header_len + mask_len];
-							std::vector<uint8_t> payload;
-							payload.assign(data, data + payload_len);
-							if (masked)
-								for (size_t k = 0; k < payload_len; ++k)
-									payload[k] ^= mask[k % 4];
-							if (opcode == 0x8) // close
-							{
-								c.closed.store(true);
-							}
-							else if (opcode == 0x9) // ping
-							{
-								std::vector<uint8_t> pong = build_ws_frame(0xA, payload.data(), payload.size());
-								c.out_buf.insert(c.out_buf.end(), pong.begin(), pong.end());
-							}
-							else if (opcode == 0xA)
-							{
-							}
-							else if (opcode == 0x1 || opcode == 0x2)
-							{
-								if (c.assembling)
-								{
-									c.assemble_data.clear();
-									c.assembling = false;
-								}
-								if (fin)
-								{
-									schedule_message(cbws, c, opcode, std::move(payload));
-								}
-								else
-								{
-									c.assembling = true;
-									c.assemble_opcode = opcode;
-									c.assemble_data = std::move(payload);
-								}
-							}
-							else if (opcode == 0x0) // continuation
-							{
-								if (!c.assembling)
-								{
-									c.closed.store(true);
-								}
-								else
-								{
-									c.assemble_data.insert(c.assemble_data.end(), payload.begin(), payload.end());
-									if (fin)
-									{
-										uint8_t final_opcode = c.assemble_opcode;
-										std::vector<uint8_t> complete;
-										complete.swap(c.assemble_data);
-										c.assembling = false;
-										schedule_message(cbws, c, final_opcode, std::move(complete));
-									}
-								}
-							}
-							c.in_buf.erase(c.in_buf.begin(), c.in_buf.begin() + header_len + mask_len + payload_len);
-						}
+						if (res >= 0)
+							ring.prep_accept_multishot(listen_fd, uring_ud(URING_ACCEPT, listen_fd));
+						else
+							ring.prep_timeout(&accept_retry, uring_ud(URING_TIMER, -1)); // e.g. EMFILE, retry later
 					}
+					continue;
 				}
-				if (ev & EPOLLOUT)
+				if (op == URING_TIMER)
 				{
-					send_all(fd, c.out_buf);
+					ring.prep_accept_multishot(listen_fd, uring_ud(URING_ACCEPT, listen_fd));
+					continue;
 				}
-				send_all(fd, c.out_buf);
-				if (c.out_buf.empty())
+				if (op == URING_TICK)
 				{
-					epoll_event mod{};
-					mod.data.fd = fd;
-					mod.events = EPOLLIN | EPOLLET;
-					epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &mod);
+					timers.advance(monotonic_ms(), [&](TimerNode& t)
+								   {
+						Client& c = *static_cast<Client*>(t.owner);
+						if (on_ping_timer(timers, c, monotonic_ms()))
+							uring_send(ring, c);
+						else if (uring_close(ring, c))
+							clients.erase(c.fd); });
+					ring.prep_timeout(&tick, uring_ud(URING_TICK, -1));
+					continue;
+				}
+				if (op == URING_EVENT)
+				{
+					drain_pending_frames([&](PendingFrame& pf)
+										 {
+						auto itc = clients.find(pf.fd);
+						if (itc == clients.end())
+							return;
+						itc->second.out.append(std::move(pf.frame));
+						uring_send(ring, itc->second); });
+					ring.prep_read(g_eventfd, &event_value, sizeof(event_value), uring_ud(URING_EVENT, g_eventfd));
+					continue;
+				}
+				if (op != URING_RECV && op != URING_SEND)
+					continue;
+				auto it = clients.find(fd);
+				if (it == clients.end())
+					continue;
+				Client& c = it->second;
+				if (op == URING_RECV)
+				{
+					if (flags & IORING_CQE_F_BUFFER)
+					{
+						uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+						if (res > 0 && !c.closing)
+						{
+							const uint8_t* data = bufs.buffer(bid);
+							c.in_buf.insert(c.in_buf.end(), data, data + res);
+							note_input(c, monotonic_ms());
+							handle_input(c, cbws, cbhttp);
+						}
+						bufs.recycle(bid);
+					}
+					else if (res == 0 || (res < 0 && res != -ENOBUFS && res != -ECANCELED))
+						c.closed.store(true);
+					if (!(flags & IORING_CQE_F_MORE))
+					{
+						c.recv_armed = false;
+						--c.ops_inflight;
+						uring_arm_recv(ring, c);
+					}
 				}
 				else
 				{
-					epoll_event mod{};
-					mod.data.fd = fd;
-					mod.events = EPOLLIN | EPOLLOUT | EPOLLET;
-					epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &mod);
+					--c.sends_inflight;
+					--c.ops_inflight;
+					if (res > 0)
+						c.out.consume((size_t)res);
+					else if (res < 0 && res != -ECANCELED)
+						c.closed.store(true);
 				}
-				if (c.closed.load() || (c.close_after_write && c.out_buf.empty()))
+				uring_send(ring, c);
+				if (c.closing || c.closed.load() || (c.close_after_write && c.out.empty()))
 				{
-					epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
-					::close(fd);
-					clients.erase(it);
+					timers.cancel(c.ping_timer);
+					if (uring_close(ring, c))
+						clients.erase(it);
 				}
 			}
 		}
+		bufs.destroy();
+		ring.destroy();
 		if (g_eventfd != -1)
 		{
 			::close(g_eventfd);
 			g_eventfd = -1;
 		}
-		::close(epfd);
+		return true;
+	}
+#endif
+
+	int serve(int port, const std::string& unix_socket, RequestReadyCallback cbws, RequestReadyCallback cbhttp)
+	{
+		int listen_fd = -1;
+		if (!unix_socket.empty())
+			listen_fd = create_unix_listen_socket(unix_socket);
+		else
+			listen_fd = create_listen_socket(port);
+		if (listen_fd == -1)
+		{
+			log_error("websocket listen failed");
+			return 1;
+		}
+		{
+			std::string addr = unix_socket.empty() ? (std::string("tcp:") + std::to_string(port)) : unix_socket;
+			log_info("Websocket server listening on %s", addr.c_str());
+		}
+		int rc = 0;
+		bool served = false;
+#ifdef WASAPI_IO_URING
+		if (global_config.io_backend == "uring")
+			served = serve_uring(listen_fd, cbws, cbhttp);
+#endif
+		if (!served)
+			rc = serve_epoll(listen_fd, cbws, cbhttp);
 		::close(listen_fd);
-		return 0;
+		return rc;
 	}
 
 } // namespace ws
@@ -5,13 +5,14 @@
 #include <cstdint>
 #include <functional>
 #include "request.h"
+#include "response.h"
 
 namespace ws
 {
-	using RequestReadyCallback = void (*)(Request&, std::vector<uint8_t>& out_payload);
-		// Serve a websocket (and plain HTTP) endpoint.
-		// cbws: called for each websocket message (text/binary). out_payload becomes response frame payload (same opcode as inbound for simplicity).
-		// cbhttp: called once per plain HTTP request received on this port (non-upgrade). out_payload is treated as the HTTP body and wrapped in a 200 OK response.
+	using RequestReadyCallback = void (*)(Request&, ResponseWriter& out);
+		// Serve a websocket (and plain HTTP) endpoint. Writers collect the whole response here (no streaming).
+		// cbws: called for each websocket message (text/binary). The collected records become the response frame payload (same opcode as inbound for simplicity).
+		// cbhttp: called once per plain HTTP request received on this port (non-upgrade). The FCGI_STDOUT content is wrapped in a 200 OK response.
 		int serve(int port, const std::string& unix_socket, RequestReadyCallback cbws, RequestReadyCallback cbhttp);
 }
 
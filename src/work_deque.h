@@ -0,0 +1,111 @@
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Chase-Lev work-stealing deque of T* (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). The owning thread pushes and pops at
+// the bottom without contention; any other thread may steal from the top, and
+// only the last element is ever fought over with a CAS. The ring doubles when
+// full; outgrown rings stay alive until the deque goes away, since a thief may
+// still be reading one.
+template <typename T>
+class WorkDeque
+{
+  public:
+	explicit WorkDeque(size_t capacity = 256)
+	{
+		rings.emplace_back(new Ring(capacity));
+		ring.store(rings.back().get(), std::memory_order_relaxed);
+	}
+	WorkDeque(const WorkDeque&) = delete;
+	WorkDeque& operator=(const WorkDeque&) = delete;
+
+	// Owner only.
+	void push(T* item)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		Ring* r = ring.load(std::memory_order_relaxed);
+		if (b - t >= (int64_t)r->mask)
+			r = grow(r, t, b);
+		r->put(b, item);
+		bottom.store(b + 1, std::memory_order_release); // publishes the item to thieves
+	}
+
+	// Owner only: newest item, nullptr when empty.
+	T* pop()
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Ring* r = ring.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		T* item = r->get(b);
+		if (t == b)
+		{
+			// last item: race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				item = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	// Any thread: oldest item, nullptr when empty or when another thread won it.
+	T* steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return nullptr;
+		Ring* r = ring.load(std::memory_order_acquire);
+		T* item = r->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return item;
+	}
+
+	bool empty() const
+	{
+		return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+	}
+
+  private:
+	struct Ring
+	{
+		explicit Ring(size_t capacity) : mask(capacity - 1), slots(new std::atomic<T*>[capacity]) {}
+		T* get(int64_t i) const { return slots[(size_t)i & mask].load(std::memory_order_relaxed); }
+		void put(int64_t i, T* v) { slots[(size_t)i & mask].store(v, std::memory_order_relaxed); }
+
+		size_t mask; // capacity is a power of two
+		std::unique_ptr<std::atomic<T*>[]> slots;
+	};
+
+	Ring* grow(Ring* old, int64_t t, int64_t b)
+	{
+		rings.emplace_back(new Ring((old->mask + 1) * 2));
+		Ring* r = rings.back().get();
+		for (int64_t i = t; i < b; ++i)
+			r->put(i, old->get(i));
+		ring.store(r, std::memory_order_release);
+		return r;
+	}
+
+	alignas(64) std::atomic<int64_t> top{ 0 }; // thieves' end
+	alignas(64) std::atomic<int64_t> bottom{ 0 }; // owner's end
+	std::atomic<Ring*> ring{ nullptr };
+	std::vector<std::unique_ptr<Ring>> rings; // owner only; every ring ever used
+};
+
+#endif // WORK_DEQUE_H
@@ -1,75 +1,272 @@
 #include "worker.h"
 #include "logger.h"
+#include "config.h"
+#include "affinity.h"
+#include "timer_wheel.h"
 
-WorkerPool global_worker_pool;
+WorkerPool global_worker_pool("worker");
+WorkerPool global_blocking_pool("blocking");
 
-WorkerPool::WorkerPool() {}
+static const unsigned SPIN_ROUNDS = 64; // empty polls before a worker parks
+static const size_t FAIR_BATCH = 4; // tasks a worker takes from the fair queue at once
+
+static thread_local WorkerPool* tls_pool = nullptr;
+static thread_local size_t tls_worker = 0;
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+WorkerPool::WorkerPool(const char* name) : name(name) {}
 WorkerPool::~WorkerPool()
 {
 	shutdown();
 }
 
-void WorkerPool::start(size_t thread_count)
+void WorkerPool::start(size_t thread_count, const std::vector<int>& cpus)
 {
 	std::lock_guard<std::mutex> lock(mtx);
 	if (running || thread_count == 0)
 		return;
 	stopping = false;
 	running = true;
-	threads.reserve(thread_count);
+	{
+		std::lock_guard<std::mutex> sched_lock(sched_mtx);
+		fair.set_weight(TASK_REQUEST, global_config.weight_fcgi);
+		fair.set_weight(TASK_HTTP, global_config.weight_http);
+		fair.set_weight(TASK_MESSAGE, global_config.weight_ws);
+	}
+	workers.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i)
+		workers.emplace_back(new Worker);
 	for (size_t i = 0; i < thread_count; ++i)
 	{
-		threads.emplace_back([this, i]
-							 {
-			register_thread_name(std::string("worker-") + std::to_string(i));
-			run(); });
+		workers[i]->thread = std::thread([this, i, cpus]
+										 {
+			register_thread_name(std::string(name) + "-" + std::to_string(i));
+			pin_thread(cpus, i);
+			run(i); });
 	}
+	thread_total.store(thread_count, std::memory_order_relaxed);
+}
+
+bool WorkerPool::enqueue(TaskNode& node)
+{
+	if (stopping.load(std::memory_order_acquire))
+		return false;
+	if (tls_pool == this)
+		workers[tls_worker]->deque.push(&node); // spawned by a task: stays local unless stolen
+	else
+		injected.push(&node); // producers: every fcgi reactor plus the ws thread
+	wake_one();
+	return true;
 }
 
 bool WorkerPool::enqueue(Task t)
 {
-	if (stopping)
+	if (stopping.load(std::memory_order_acquire))
 		return false;
-	q.push(std::move(t));
-	cv.notify_one();
+	TaskNode* n = new TaskNode;
+	n->fn = std::move(t);
+	n->owned = true;
+	if (!enqueue(*n))
+	{
+		delete n;
+		return false;
+	}
 	return true;
 }
 
+// A task that will never run still gets its on_drop hook, as run() gives an
+// expired one, so the owner is let go of.
+static void drop(TaskNode* n)
+{
+	void (*on_drop)(void*) = n->on_drop;
+	void* owner = n->owner;
+	if (n->owned)
+		delete n;
+	else
+		n->fn = nullptr; // releases the captures; the owner frees the node
+	if (on_drop)
+		on_drop(owner);
+}
+
 void WorkerPool::shutdown()
 {
 	{
-		std::unique_lock<std::mutex> lock(mtx);
+		std::lock_guard<std::mutex> lock(mtx);
 		if (!running)
 			return;
 		stopping = true;
+		++wake_epoch;
 	}
 	cv.notify_all();
-	for (auto& th : threads)
+	for (auto& w : workers)
+	{
+		if (w->thread.joinable())
+			w->thread.join();
+	}
+	// whatever slipped in after the workers drained is dropped unrun
+	for (auto& w : workers)
 	{
-		if (th.joinable())
-			th.join();
+		while (TaskNode* n = w->deque.pop())
+			drop(n);
 	}
-	threads.clear();
+	for (TaskNode* n = injected.take_all(); n;)
+	{
+		TaskNode* next = n->next;
+		drop(n);
+		n = next;
+	}
+	std::vector<TaskNode*> unscheduled;
+	{
+		std::lock_guard<std::mutex> sched_lock(sched_mtx);
+		while (TaskNode* n = fair.pop())
+			unscheduled.push_back(n);
+		scheduled.store(0, std::memory_order_relaxed);
+	}
+	for (TaskNode* n : unscheduled)
+		drop(n); // outside the lock, the hooks may take their own
+	workers.clear();
+	thread_total.store(0, std::memory_order_relaxed);
+	if (uint64_t n = dropped.load(std::memory_order_relaxed))
+		log_info("%s pool dropped %llu expired tasks", name, (unsigned long long)n);
 	running = false;
-	while (!q.empty())
-		q.pop();
 }
 
-void WorkerPool::run()
+void WorkerPool::run(size_t self)
 {
+	tls_pool = this;
+	tls_worker = self;
+	unsigned idle = 0;
 	while (true)
 	{
-		Task task;
+		if (TaskNode* n = find_task(self))
 		{
-			std::unique_lock<std::mutex> lock(mtx);
-			cv.wait(lock, [&]
-					{ return stopping || !q.empty(); });
-			if (stopping && q.empty())
-				break;
-			task = std::move(q.front());
-			q.pop();
+			idle = 0;
+			Task fn = std::move(n->fn); // the task may free the node's owner
+			bool dead = (n->token || n->deadline_ms) && n->expired(n->deadline_ms ? monotonic_ms() : 0);
+			void (*on_drop)(void*) = n->on_drop;
+			void* owner = n->owner;
+			if (n->owned)
+				delete n;
+			if (dead)
+			{
+				fn = nullptr; // its captures go before the owner does
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				if (on_drop)
+					on_drop(owner);
+			}
+			else if (fn)
+				fn();
+			continue;
 		}
-		if (task)
-			task();
+		if (stopping.load(std::memory_order_acquire))
+			break;
+		if (++idle < SPIN_ROUNDS)
+		{
+			cpu_relax();
+			continue;
+		}
+		park();
+		idle = 0;
 	}
+	tls_pool = nullptr;
+}
+
+// Own deque first, then the fair queue, then the other workers.
+TaskNode* WorkerPool::find_task(size_t self)
+{
+	Worker& me = *workers[self];
+	if (TaskNode* n = me.deque.pop())
+		return n;
+	if (TaskNode* n = schedule(me))
+		return n;
+	size_t count = workers.size();
+	for (size_t i = 1; i < count; ++i)
+	{
+		Worker& victim = *workers[(self + i) % count];
+		if (TaskNode* n = victim.deque.steal())
+		{
+			if (!victim.deque.empty())
+				wake_one();
+			return n;
+		}
+	}
+	return nullptr;
+}
+
+// Take the next tasks in fair order: the first is returned, the rest go to our
+// deque. Whoever holds the lock is already doing this, so nobody waits for it.
+TaskNode* WorkerPool::schedule(Worker& me)
+{
+	if (injected.empty() && scheduled.load(std::memory_order_relaxed) == 0)
+		return nullptr; // spinners only read the lines
+	if (!sched_mtx.try_lock())
+		return nullptr;
+	for (TaskNode* n = injected.take_all(); n;)
+	{
+		TaskNode* next = n->next;
+		fair.push(n);
+		n = next;
+	}
+	TaskNode* batch[FAIR_BATCH];
+	size_t k = 0;
+	while (k < FAIR_BATCH && (batch[k] = fair.pop()))
+		++k;
+	size_t left = fair.size();
+	scheduled.store(left, std::memory_order_relaxed);
+	sched_mtx.unlock();
+	if (k == 0)
+		return nullptr;
+	for (size_t i = k; i-- > 1;)
+		me.deque.push(batch[i]); // our pops from the bottom keep the fair order
+	if (k > 1 || left > 0)
+		wake_one(); // let a parked worker steal or schedule the rest
+	return batch[0];
+}
+
+bool WorkerPool::has_work() const
+{
+	if (!injected.empty() || scheduled.load(std::memory_order_relaxed) > 0)
+		return true;
+	for (auto& w : workers)
+	{
+		if (!w->deque.empty())
+			return true;
+	}
+	return false;
+}
+
+// Announce the sleep before the last look at the queues; wake_one() publishes
+// work before it looks at sleepers, so one of the two always sees the other.
+void WorkerPool::park()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	sleepers.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!has_work() && !stopping.load(std::memory_order_relaxed))
+	{
+		uint64_t epoch = wake_epoch;
+		cv.wait(lock, [&]
+				{ return wake_epoch != epoch || stopping.load(std::memory_order_relaxed); });
+	}
+	sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void WorkerPool::wake_one()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleepers.load(std::memory_order_relaxed) == 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		++wake_epoch;
+	}
+	cv.notify_one();
 }
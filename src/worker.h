@@ -1,39 +1,76 @@
 #ifndef WORKER_H
 #define WORKER_H
 
-#include <functional>
+#include <memory>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
 #include <atomic>
+#include "mpsc_queue.h"
+#include "work_deque.h"
+#include "task.h"
+#include "fair_queue.h"
 
+// Work-stealing pool. Each worker owns a Chase-Lev deque; tasks enqueued from
+// outside the pool (the IO threads) land in a shared lock-free injection queue.
+// An idle worker that gets the scheduler lock (try_lock, nobody waits for it)
+// moves what was injected into a FairQueue and takes the next few tasks in fair
+// order into its own deque, where the others can steal from. A worker without
+// work spins for a short while and then parks. Tasks are queued through an
+// intrusive TaskNode, so enqueue(TaskNode&) never allocates; its task_class and
+// tenant pick the place in the fair order. A task whose token is cancelled or
+// whose deadline has passed by the time a worker picks it up is not run; the
+// node's on_drop hook runs instead, as it does for tasks left queued at shutdown.
 class WorkerPool
 {
   public:
-	using Task = std::function<void()>;
+	using Task = ::Task;
 
-	WorkerPool();
+	explicit WorkerPool(const char* name); // thread names are "<name>-<i>"
 	~WorkerPool();
 
-	void start(size_t thread_count);
+	void start(size_t thread_count, const std::vector<int>& cpus = {}); // cpus: pin worker i to cpus[i % n]
+	size_t size() const { return thread_total.load(std::memory_order_relaxed); } // 0 until started
 
-	bool enqueue(Task t);
+	// The node must stay put until its task starts; it is not touched after that,
+	// so the task may free whatever holds the node.
+	bool enqueue(TaskNode& node);
+	bool enqueue(Task t); // allocates the node
 
 	void shutdown();
 
   private:
-	void run();
+	struct Worker
+	{
+		WorkDeque<TaskNode> deque;
+		std::thread thread;
+	};
 
-	std::vector<std::thread> threads;
-	std::mutex mtx;
+	void run(size_t self);
+	TaskNode* find_task(size_t self);
+	TaskNode* schedule(Worker& me);
+	bool has_work() const;
+	void park();
+	void wake_one();
+
+	const char* name;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<size_t> thread_total{ 0 };
+	MpscQueue<TaskNode> injected; // tasks from threads outside the pool
+	std::mutex sched_mtx; // guards fair
+	FairQueue fair; // injected tasks not handed to a worker yet
+	std::atomic<size_t> scheduled{ 0 }; // fair.size(), readable without the lock
+	std::mutex mtx; // start/shutdown and parking
 	std::condition_variable cv;
-	std::queue<Task> q;
+	std::atomic<size_t> sleepers{ 0 };
+	uint64_t wake_epoch = 0; // guarded by mtx, bumped to wake parked workers
+	std::atomic<uint64_t> dropped{ 0 }; // expired tasks not run, logged at shutdown
 	std::atomic<bool> running{ false };
-	bool stopping = false;
+	std::atomic<bool> stopping{ false };
 };
 
-extern WorkerPool global_worker_pool;
+extern WorkerPool global_worker_pool; // request handlers, sized to the cores
+extern WorkerPool global_blocking_pool; // request stages that wait on the disk
 
 #endif // WORKER_H